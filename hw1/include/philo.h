@@ -0,0 +1,124 @@
+#ifndef PHILO_H
+#define PHILO_H
+
+#include <stdio.h>
+
+/*
+ * Declarations shared between source files that go beyond the interface
+ * fixed by global.h.
+ */
+
+/*
+ * Additional bits that are OR-ed in to global_options to select the
+ * clustering method used instead of neighbor joining.
+ */
+#define UPGMA_OPTION     (0x00000008)
+#define WPGMA_OPTION     (0x00000010)
+
+/*
+ * Bit set in global_options by -r <file1> <file2>, which compares two
+ * trees in Newick format instead of building a tree.  The program then
+ * exits with EXIT_SUCCESS if the trees have the same topology,
+ * EXIT_FAILURE if they differ, and COMPARE_TROUBLE if either could not be
+ * read or their leaves do not match.
+ */
+#define COMPARE_OPTION   (0x00000020)
+#define COMPARE_TROUBLE  2
+
+/* Names of the two files given with -r. */
+extern char *compare_files[2];
+
+/*
+ * Bits set in global_options by -s <socket>, which runs a server that
+ * builds trees for requests received on a Unix domain socket, and by
+ * -c <socket>, which sends the input and the remaining options to such a
+ * server and outputs its response.
+ */
+#define SERVE_OPTION     (0x00000040)
+#define CLIENT_OPTION    (0x00000080)
+
+/* Path of the socket given with -s or -c. */
+extern char *socket_path;
+
+/*
+ * Print help for the options that the USAGE macro in global.h does not
+ * describe, in validargs.c.
+ */
+extern void usage_more_options(void);
+
+/*
+ * Bit set in global_options by -t (trust symmetry).  For a full square
+ * distance matrix, the entries below the diagonal are then skipped without
+ * being parsed and taken from the entries above it, instead of being
+ * checked against them.
+ */
+#define TRUST_SYMMETRIC_OPTION (0x00000100)
+
+/*
+ * Counts of the basic operations performed by the readers, tree builders
+ * and emitters.  They are deterministic for a given input, so tests can
+ * put upper bounds on the work done instead of timing it.
+ *   q_evaluations - pairs examined when selecting the next join
+ *   cells_touched - distance matrix entries read or written
+ *   bytes_moved - bytes copied to retire joined nodes from the active set
+ *   allocations - heap allocations
+ *   write_calls - stdio calls made to write output
+ */
+typedef struct op_counts {
+    long q_evaluations;
+    long cells_touched;
+    long bytes_moved;
+    long allocations;
+    long write_calls;
+} OP_COUNTS;
+
+extern OP_COUNTS op_counts;
+
+/*
+ * Wrappers in philo.c through which output is written and heap memory is
+ * allocated.  Each call counts one write call or allocation in op_counts,
+ * so the counts follow the calls actually made.
+ */
+extern int counted_printf(FILE *out, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+extern int counted_putc(int c, FILE *out);
+extern int counted_puts(const char *s, FILE *out);
+extern void *counted_malloc(size_t size);
+extern void *counted_calloc(size_t count, size_t size);
+extern void *counted_realloc(void *ptr, size_t size);
+
+/*
+ * Name internal node u "#u", in philo.c; used by all the tree builders.
+ */
+extern void name_internal_node(int u);
+
+/*
+ * Read, build and emit according to global_options, in philo.c.
+ */
+extern int run_taxonomy(FILE *in, FILE *out);
+
+/*
+ * Functions in decompress.c for reading gzip- or zstd-compressed input.
+ * See the comments in front of each function for full specifications.
+ */
+extern int is_compressed_input(FILE *in);
+extern FILE *open_decompressed(FILE *in);
+extern int close_decompressed(FILE *dec);
+
+/*
+ * UPGMA/WPGMA tree construction in upgma.c, an alternative to build_taxonomy().
+ */
+extern int build_upgma(FILE *out, int weighted);
+
+/*
+ * Robinson-Foulds comparison of two Newick trees in compare.c.
+ */
+extern int compare_trees(char *file1, char *file2, FILE *out);
+
+/*
+ * Server and client for building trees over a Unix domain socket, in serve.c.
+ */
+extern int serve(char *path);
+extern int client(char *path, int argc, char **argv);
+
+#endif
@@ -0,0 +1,431 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "global.h"
+#include "philo.h"
+#include "debug.h"
+
+/* Names of the two Newick files to compare, set by validargs. */
+char *compare_files[2];
+
+int compare(const char *str1, const char *str2);
+
+/*
+ * A tree parsed from Newick text.  Nodes are stored in preorder, so every
+ * subtree occupies a contiguous range of indices starting at its root and
+ * every child has a larger index than its parent.  Node names point into
+ * the names buffer.  As for trees built by build_taxonomy(), neighbors[0]
+ * holds the parent and neighbors[1], neighbors[2] the children; the root,
+ * having no parent, may keep a third child in neighbors[0].
+ */
+typedef struct newick_tree {
+    char *text;
+    char *names;
+    size_t names_len;
+    NODE *nodes;
+    int *parent;     /* Index of the parent of each node, -1 for the root. */
+    int *end;        /* One past the last index of the subtree at each node. */
+    int *leaf_id;    /* Leaf number (common to both trees), -1 for internal nodes. */
+    int leaf0;       /* Index of the node with leaf number 0. */
+    int num_nodes;
+    int num_leaves;
+} TREE;
+
+/* A nontrivial bipartition of the leaves, identified by a 64-bit hash. */
+typedef struct split {
+    uint64_t hash;
+    int node;        /* Node whose edge to its parent induces the split. */
+} SPLIT;
+
+/* Read the entire contents of a file into a null-terminated buffer. */
+static char *read_file(char *name) {
+    FILE *f = fopen(name, "r");
+    size_t len = 0, cap = 1 << 16;
+    char *buf;
+    if (f == NULL) {
+        fprintf(stderr, "Unable to open '%s'\n", name);
+        return NULL;
+    }
+    if ((buf = counted_malloc(cap)) == NULL) {
+        fclose(f);
+        return NULL;
+    }
+    size_t n;
+    while ((n = fread(buf + len, 1, cap - len - 1, f)) > 0) {
+        len += n;
+        if (len == cap - 1) {
+            char *p = counted_realloc(buf, cap *= 2);
+            if (p == NULL) {
+                free(buf);
+                fclose(f);
+                return NULL;
+            }
+            buf = p;
+        }
+    }
+    buf[len] = '\0';
+    fclose(f);
+    return buf;
+}
+
+/*
+ * Labels may contain spaces, since emit_newick_format() writes taxon names
+ * as they are, unquoted; only the ends of a label are trimmed.
+ */
+static int is_label_char(int c) {
+    return c != '\0' && c != '(' && c != ')' && c != ',' && c != ':' && c != ';'
+        && c != '\n' && c != '\r';
+}
+
+static char *skip_space(char *p) {
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+        p++;
+    return p;
+}
+
+/*
+ * Parse an optional label and an optional ":length" at p.  The label is
+ * copied to the names buffer and stored as the name of node v.
+ */
+static char *parse_label(TREE *t, int v, char *p) {
+    char *name = t->names + t->names_len;
+    p = skip_space(p);
+    while (is_label_char(*p))
+        t->names[t->names_len++] = *p++;
+    while (t->names + t->names_len > name
+           && (t->names[t->names_len - 1] == ' ' || t->names[t->names_len - 1] == '\t'))
+        t->names_len--;
+    t->names[t->names_len++] = '\0';
+    t->nodes[v].name = name;
+    p = skip_space(p);
+    if (*p == ':') {
+        p = skip_space(p + 1);
+        strtod(p, &p);
+        p = skip_space(p);
+    }
+    return p;
+}
+
+/* Attach node v as a child of node u. */
+static int add_child(TREE *t, int u, int v) {
+    NODE *nu = &t->nodes[u];
+    t->parent[v] = u;
+    t->nodes[v].neighbors[0] = nu;
+    if (nu->neighbors[1] == NULL)
+        nu->neighbors[1] = &t->nodes[v];
+    else if (nu->neighbors[2] == NULL)
+        nu->neighbors[2] = &t->nodes[v];
+    else if (t->parent[u] == -1 && nu->neighbors[0] == NULL)
+        nu->neighbors[0] = &t->nodes[v];
+    else
+        return -1;
+    return 0;
+}
+
+/*
+ * Parse a Newick tree from the contents of a file.  Parsing is iterative,
+ * so deep (e.g. caterpillar) trees do not exhaust the stack.  Only binary
+ * trees are accepted, except that the root may have three children as in
+ * the usual representation of an unrooted tree.
+ */
+static int parse_newick(TREE *t, char *name) {
+    memset(t, 0, sizeof(*t));
+    if ((t->text = read_file(name)) == NULL)
+        return -1;
+
+    // Every node is preceded by '(' or ',' except the first leaf
+    int max_nodes = 2;
+    size_t len = 0;
+    for (char *p = t->text; *p != '\0'; p++, len++)
+        if (*p == '(' || *p == ',')
+            max_nodes++;
+    t->names = counted_malloc(len + max_nodes);
+    t->nodes = counted_calloc(max_nodes, sizeof(NODE));
+    t->parent = counted_malloc(max_nodes * sizeof(int));
+    t->end = counted_malloc(max_nodes * sizeof(int));
+    t->leaf_id = counted_malloc(max_nodes * sizeof(int));
+    if (t->names == NULL || t->nodes == NULL || t->parent == NULL || t->end == NULL || t->leaf_id == NULL) {
+        fprintf(stderr, "Out of memory parsing '%s'\n", name);
+        return -1;
+    }
+
+    char *p = skip_space(t->text);
+    int cur = -1;        // Innermost open internal node
+    int expect_node = 1;
+    while (1) {
+        p = skip_space(p);
+        if (expect_node) {
+            int v = t->num_nodes++;
+            t->parent[v] = -1;
+            if (cur != -1 && add_child(t, cur, v) != 0) {
+                fprintf(stderr, "'%s': only binary trees are supported\n", name);
+                return -1;
+            }
+            if (*p == '(') {
+                cur = v;
+                p++;
+                continue;
+            }
+            p = parse_label(t, v, p);
+            if (t->nodes[v].name[0] == '\0') {
+                fprintf(stderr, "'%s': missing leaf name\n", name);
+                return -1;
+            }
+            expect_node = 0;
+        } else if (*p == ',' && cur != -1) {
+            expect_node = 1;
+            p++;
+        } else if (*p == ')' && cur != -1) {
+            int closed = cur;
+            cur = t->parent[cur];
+            p = parse_label(t, closed, p + 1);
+        } else if (*p == ';' && cur == -1) {
+            break;
+        } else {
+            fprintf(stderr, "'%s': malformed Newick tree\n", name);
+            return -1;
+        }
+    }
+
+    // Children follow their parents, so a reverse scan finishes each subtree
+    for (int v = 0; v < t->num_nodes; v++) {
+        t->end[v] = v + 1;
+        t->leaf_id[v] = -1;
+        if (t->nodes[v].neighbors[1] == NULL)
+            t->num_leaves++;
+    }
+    for (int v = t->num_nodes - 1; v > 0; v--)
+        if (t->end[v] > t->end[t->parent[v]])
+            t->end[t->parent[v]] = t->end[v];
+    return 0;
+}
+
+static void free_tree(TREE *t) {
+    free(t->text);
+    free(t->names);
+    free(t->nodes);
+    free(t->parent);
+    free(t->end);
+    free(t->leaf_id);
+}
+
+static uint64_t hash_string(const char *s) {
+    uint64_t h = 14695981039346656037ULL;
+    while (*s)
+        h = (h ^ (unsigned char)*s++) * 1099511628211ULL;
+    return h;
+}
+
+/* A well-mixed 64-bit key for each leaf number (splitmix64). */
+static uint64_t leaf_key(int id) {
+    uint64_t z = (uint64_t)id * 0x9e3779b97f4a7c15ULL + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * Number the leaves of both trees consistently, by order of appearance in
+ * the first tree, using an open-addressed hash table on the leaf names.
+ */
+static int number_leaves(TREE *t1, TREE *t2) {
+    int size = 1;
+    while (size < 2 * t1->num_leaves)
+        size <<= 1;
+    int *table = counted_malloc(size * sizeof(int));
+    int *seen = counted_calloc(t1->num_leaves, sizeof(int));
+    int ret = 0, id = 0;
+    if (table == NULL || seen == NULL) {
+        free(table);
+        free(seen);
+        return -1;
+    }
+    memset(table, -1, size * sizeof(int));
+
+    for (int v = 0; v < t1->num_nodes && ret == 0; v++) {
+        if (t1->nodes[v].neighbors[1] != NULL)
+            continue;
+        int h = hash_string(t1->nodes[v].name) & (size - 1);
+        while (table[h] != -1 && compare(t1->nodes[table[h]].name, t1->nodes[v].name) != 0)
+            h = (h + 1) & (size - 1);
+        if (table[h] != -1) {
+            fprintf(stderr, "Duplicate leaf '%s' in first tree\n", t1->nodes[v].name);
+            ret = -1;
+        }
+        table[h] = v;
+        if (id == 0)
+            t1->leaf0 = v;
+        t1->leaf_id[v] = id++;
+    }
+    for (int v = 0; v < t2->num_nodes && ret == 0; v++) {
+        if (t2->nodes[v].neighbors[1] != NULL)
+            continue;
+        int h = hash_string(t2->nodes[v].name) & (size - 1);
+        while (table[h] != -1 && compare(t1->nodes[table[h]].name, t2->nodes[v].name) != 0)
+            h = (h + 1) & (size - 1);
+        if (table[h] == -1 || seen[t1->leaf_id[table[h]]]++) {
+            fprintf(stderr, "Leaf '%s' of second tree does not match first tree\n",
+                    t2->nodes[v].name);
+            ret = -1;
+        } else {
+            t2->leaf_id[v] = t1->leaf_id[table[h]];
+            if (t2->leaf_id[v] == 0)
+                t2->leaf0 = v;
+        }
+    }
+    if (ret == 0 && t1->num_leaves != t2->num_leaves) {
+        fprintf(stderr, "Trees have different numbers of leaves\n");
+        ret = -1;
+    }
+    free(table);
+    free(seen);
+    return ret;
+}
+
+static int compare_splits(const void *a, const void *b) {
+    uint64_t x = ((const SPLIT *)a)->hash, y = ((const SPLIT *)b)->hash;
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Compute the nontrivial splits of a tree.  The hash of the leaf set below
+ * each node is the XOR of its leaf keys, accumulated bottom-up in one
+ * linear pass; a bipartition is identified by the smaller of the hashes of
+ * its two sides.  The splits are returned sorted and without duplicates
+ * (the two edges at a root of degree 2 induce the same split).
+ */
+static SPLIT *tree_splits(TREE *t, int *count) {
+    uint64_t *h = counted_calloc(t->num_nodes, sizeof(uint64_t));
+    int *size = counted_calloc(t->num_nodes, sizeof(int));
+    SPLIT *splits = counted_malloc(t->num_nodes * sizeof(SPLIT));
+    uint64_t total = 0;
+    int n = 0;
+    if (h == NULL || size == NULL || splits == NULL) {
+        free(h);
+        free(size);
+        free(splits);
+        return NULL;
+    }
+
+    for (int v = t->num_nodes - 1; v >= 0; v--) {
+        if (t->leaf_id[v] != -1) {
+            h[v] = leaf_key(t->leaf_id[v]);
+            size[v] = 1;
+            total ^= h[v];
+        }
+        if (v > 0) {
+            h[t->parent[v]] ^= h[v];
+            size[t->parent[v]] += size[v];
+        }
+    }
+    for (int v = 1; v < t->num_nodes; v++) {
+        if (size[v] < 2 || size[v] > t->num_leaves - 2)
+            continue;
+        splits[n].hash = h[v] < (h[v] ^ total) ? h[v] : h[v] ^ total;
+        splits[n].node = v;
+        n++;
+    }
+    qsort(splits, n, sizeof(SPLIT), compare_splits);
+    int m = 0;
+    for (int k = 0; k < n; k++)
+        if (m == 0 || splits[k].hash != splits[m - 1].hash)
+            splits[m++] = splits[k];
+
+    free(h);
+    free(size);
+    *count = m;
+    return splits;
+}
+
+/*
+ * Print the side of the split induced by node v that does not contain
+ * leaf number 0, so the same split prints identically for both trees.
+ */
+static void print_split(FILE *out, char tag, TREE *t, int v) {
+    int inside = t->leaf0 >= v && t->leaf0 < t->end[v];
+    // The subtree of v is the index range [v, end[v]); only the printed
+    // side is visited, so the cost is proportional to the output.
+    int ranges[2][2] = {{v, t->end[v]}, {0, 0}};
+    if (inside) {
+        ranges[0][0] = 0;
+        ranges[0][1] = v;
+        ranges[1][0] = t->end[v];
+        ranges[1][1] = t->num_nodes;
+    }
+    char sep = '{';
+    fprintf(out, "%c ", tag);
+    for (int r = 0; r < 2; r++) {
+        for (int k = ranges[r][0]; k < ranges[r][1]; k++) {
+            if (t->leaf_id[k] == -1)
+                continue;
+            fprintf(out, "%c%s", sep, t->nodes[k].name);
+            sep = ',';
+        }
+    }
+    fprintf(out, "}\n");
+}
+
+/**
+ * @brief  Compare two trees in Newick format by Robinson-Foulds distance.
+ * @details  This function parses the trees in two files, such as those
+ * written by emit_newick_format(), and compares their topologies as
+ * unrooted trees.  Each nontrivial bipartition of the leaves induced by an
+ * edge is identified by a 64-bit hash of its leaf set, so all splits of a
+ * tree are found in a single linear pass and matched by sorting.  The
+ * output is a line giving the Robinson-Foulds distance (the number of
+ * splits present in only one of the trees), followed by one line for each
+ * such split: '<' for splits only in the first tree and '>' for splits only
+ * in the second, each listing the leaves on the side of the split that does
+ * not contain the first leaf of the first tree.  Edge lengths and names of
+ * internal nodes are ignored.
+ *
+ * @param file1  Name of the file containing the first tree.
+ * @param file2  Name of the file containing the second tree.
+ * @param out  Stream to which to output the comparison.
+ * @return the Robinson-Foulds distance, or -1 if either tree could not be
+ * read or the trees do not have the same set of leaves.
+ */
+int compare_trees(char *file1, char *file2, FILE *out) {
+    TREE t1 = {0}, t2 = {0};
+    SPLIT *s1 = NULL, *s2 = NULL;
+    int n1 = 0, n2 = 0, ret = -1;
+
+    if (parse_newick(&t1, file1) == 0 && parse_newick(&t2, file2) == 0
+        && number_leaves(&t1, &t2) == 0
+        && (s1 = tree_splits(&t1, &n1)) != NULL
+        && (s2 = tree_splits(&t2, &n2)) != NULL) {
+        int i = 0, j = 0, shared = 0;
+        while (i < n1 && j < n2) {
+            if (s1[i].hash == s2[j].hash) {
+                shared++;
+                i++;
+                j++;
+            } else if (s1[i].hash < s2[j].hash) {
+                i++;
+            } else {
+                j++;
+            }
+        }
+        ret = n1 + n2 - 2 * shared;
+        fprintf(out, "RF distance: %d (%d splits only in first tree, %d only in second, %d shared)\n",
+                ret, n1 - shared, n2 - shared, shared);
+        for (i = 0, j = 0; i < n1 || j < n2; ) {
+            if (i < n1 && j < n2 && s1[i].hash == s2[j].hash) {
+                i++;
+                j++;
+            } else if (j == n2 || (i < n1 && s1[i].hash < s2[j].hash)) {
+                print_split(out, '<', &t1, s1[i++].node);
+            } else {
+                print_split(out, '>', &t2, s2[j++].node);
+            }
+        }
+    }
+
+    free(s1);
+    free(s2);
+    free_tree(&t1);
+    free_tree(&t2);
+    return ret;
+}
@@ -0,0 +1,179 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "global.h"
+#include "philo.h"
+#include "debug.h"
+
+/* Size of the stdio buffer on the decompressed stream. */
+#define DECOMPRESS_BUFSIZE (1 << 18)
+
+/* First byte of the gzip (1f 8b) and zstd (28 b5 2f fd) magic numbers. */
+#define GZIP_MAGIC0 0x1f
+#define ZSTD_MAGIC0 0x28
+
+static pid_t decompressor_pid = -1;
+static pid_t feeder_pid = -1;
+static char *dec_buf = NULL;
+
+/**
+ * @brief  Determine whether an input stream holds compressed data.
+ * @details  Peeks at the first byte of the stream, which is pushed back
+ * so that it will be seen again by the next read.  Neither magic byte can
+ * begin a valid distance file (which starts with '#' or ',' for CSV, or
+ * with a digit or whitespace for PHYLIP), so the decompressor itself is
+ * left to check the rest of the magic number.
+ *
+ * @param in  The input stream, positioned at the start of the data.
+ * @return 1 for gzip, 2 for zstd, 0 if the data is not compressed.
+ */
+int is_compressed_input(FILE *in) {
+    int c = getc(in);
+    if (c == EOF)
+        return 0;
+    ungetc(c, in);
+    if (c == GZIP_MAGIC0)
+        return 1;
+    if (c == ZSTD_MAGIC0)
+        return 2;
+    return 0;
+}
+
+/**
+ * @brief  Open a stream that yields the decompressed contents of another.
+ * @details  The decompression is done by a gzip or zstd child process that
+ * runs concurrently with the caller, so the parser consumes data as soon
+ * as it has been inflated.  If the input is seekable (e.g. a file
+ * redirected to stdin) the decompressor reads its descriptor directly;
+ * otherwise a second child copies the already-buffered bytes and the
+ * remainder of the stream into the decompressor's pipe.  The returned
+ * stream must be closed with close_decompressed().
+ *
+ * The gzip and zstd programs are run by name, so the one needed must be
+ * installed and on the PATH.  If it cannot be run, the stream yields no
+ * data and close_decompressed() reports an error.
+ *
+ * @param in  The compressed input stream, positioned at the start of the
+ * compressed data.
+ * @return  A stream of decompressed data, or NULL if an error occurred.
+ */
+FILE *open_decompressed(FILE *in) {
+    int kind = is_compressed_input(in);
+    char *prog = kind == 2 ? "zstd" : "gzip";
+    int in_fd = fileno(in);
+    off_t pos = ftello(in);
+    int feed[2] = {-1, -1}, data[2];
+
+    if (kind == 0)
+        return NULL;
+    if (pipe(data) == -1) {
+        fprintf(stderr, "Unable to create pipe for %s\n", prog);
+        return NULL;
+    }
+    // Seekable input can be handed to the decompressor as is
+    if (pos == -1 || lseek(in_fd, pos, SEEK_SET) == -1) {
+        if (pipe(feed) == -1) {
+            fprintf(stderr, "Unable to create pipe for %s\n", prog);
+            close(data[0]);
+            close(data[1]);
+            return NULL;
+        }
+        in_fd = feed[0];
+    }
+
+    decompressor_pid = fork();
+    if (decompressor_pid == 0) {
+        dup2(in_fd, STDIN_FILENO);
+        dup2(data[1], STDOUT_FILENO);
+        close(data[0]);
+        close(data[1]);
+        if (feed[0] != -1) {
+            close(feed[0]);
+            close(feed[1]);
+        }
+        execlp(prog, prog, "-dc", (char *)NULL);
+        fprintf(stderr, "Unable to run %s\n", prog);
+        _exit(127);
+    }
+    close(data[1]);
+    if (decompressor_pid == -1) {
+        fprintf(stderr, "Unable to start %s\n", prog);
+        close(data[0]);
+        return NULL;
+    }
+
+    if (feed[0] != -1) {
+        feeder_pid = fork();
+        if (feeder_pid == 0) {
+            char buf[1 << 16];
+            size_t n;
+            close(feed[0]);
+            close(data[0]);
+            while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+                if (write(feed[1], buf, n) != (ssize_t)n)
+                    _exit(EXIT_FAILURE);
+            }
+            _exit(ferror(in) ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+        close(feed[0]);
+        close(feed[1]);
+    }
+
+    FILE *dec = fdopen(data[0], "r");
+    if (dec == NULL) {
+        close(data[0]);
+        return NULL;
+    }
+    dec_buf = counted_malloc(DECOMPRESS_BUFSIZE);
+    if (dec_buf != NULL)
+        setvbuf(dec, dec_buf, _IOFBF, DECOMPRESS_BUFSIZE);
+    return dec;
+}
+
+/*
+ * Wait for a child started by open_decompressed().  A child killed by
+ * SIGPIPE is not an error: the parser stops reading after the last data
+ * line, and any trailing input is ignored.
+ */
+static int reap(pid_t *pid) {
+    int status;
+    int ret = 0;
+    if (*pid > 0) {
+        if (waitpid(*pid, &status, 0) == -1)
+            ret = -1;
+        else if (WIFSIGNALED(status))
+            ret = WTERMSIG(status) == SIGPIPE ? 0 : -1;
+        else if (WEXITSTATUS(status) != EXIT_SUCCESS)
+            ret = -1;
+        *pid = -1;
+    }
+    return ret;
+}
+
+/**
+ * @brief  Close a stream returned by open_decompressed().
+ * @details  Waits for the child processes so that truncated or corrupt
+ * compressed input is reported as an error.
+ *
+ * @param dec  The stream to close.
+ * @return 0 if decompression completed successfully, otherwise -1.
+ */
+int close_decompressed(FILE *dec) {
+    int ret = 0;
+    fclose(dec);
+    free(dec_buf);
+    dec_buf = NULL;
+    if (reap(&decompressor_pid) != 0) {
+        fprintf(stderr, "Error decompressing input\n");
+        ret = -1;
+    }
+    if (reap(&feeder_pid) != 0)
+        ret = -1;
+    return ret;
+}
@@ -2,43 +2,59 @@
 #include <stdlib.h>
 
 #include "global.h"
+#include "philo.h"
 #include "debug.h"
 
-double matrix[MAX_NODES][MAX_NODES]; //Pre-declared 2D array to store the matrix
+/*
+ * Size of the stdio buffers used for input and output.  Output is fully
+ * buffered so that edge lines and Newick/matrix text reach the kernel in
+ * large chunks instead of one write per line (stdout is line buffered on
+ * a terminal and would otherwise flush on every edge).
+ */
+#define IO_BUFSIZE (1 << 16)
 
-int readAndValidateMatrix() {
-    int numNodes = 0; // To keep track of the number of nodes read.
-    char line[1024]; // Buffer to read each line
-
-    return 0;
-}
+static char in_buf[IO_BUFSIZE];
+static char out_buf[IO_BUFSIZE];
 
 int main(int argc, char **argv)
 {
-    if(validargs(argc, argv))
+    // USAGE exits; the help for options it does not cover follows it
+    if(validargs(argc, argv)) {
+        atexit(usage_more_options);
         USAGE(*argv, EXIT_FAILURE);
-    if(global_options == HELP_OPTION)
+    }
+    if(global_options == HELP_OPTION) {
+        atexit(usage_more_options);
         USAGE(*argv, EXIT_SUCCESS);
-    // Check for MATRIX_OPTION
-    if(global_options & MATRIX_OPTION) {
-        // Implement the logic for the matrix mode
-        // Read from stdin, process, write to stdout
     }
 
-    // Check for NEWICK_OPTION
-    if(global_options & NEWICK_OPTION) {
-        // Implement the logic for the Newick mode
-        // If outlier_name is set, you also have the `-o` flag provided
-        // Read from stdin, process, write to stdout
+    setvbuf(stdin, in_buf, _IOFBF, sizeof(in_buf));
+    setvbuf(stdout, out_buf, _IOFBF, sizeof(out_buf));
+
+    if(global_options & COMPARE_OPTION) {
+        // As with cmp(1): 0 if the trees are the same, 1 if they differ,
+        // and 2 if they could not be compared
+        int rf = compare_trees(compare_files[0], compare_files[1], stdout);
+        fflush(stdout);
+        if(rf < 0)
+            return COMPARE_TROUBLE;
+        return rf == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
-    // If everything goes well
-    return EXIT_SUCCESS;
+    if(global_options & SERVE_OPTION)
+        return serve(socket_path) ? EXIT_FAILURE : EXIT_SUCCESS;
+    if(global_options & CLIENT_OPTION)
+        return client(socket_path, argc, argv);
+
+    // Row sums and symmetry are checked row by row as the input is parsed
+    if(run_taxonomy(stdin, stdout))
+        return EXIT_FAILURE;
 
-    // If there's an error during processing, before the return statement above, you can:
-    // fprintf(stderr, "Error message here");
-    // return EXIT_FAILURE;
-    return EXIT_FAILURE;
+    if(fflush(stdout) == EOF) {
+        fprintf(stderr, "Error writing output\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
 }
 
 /*
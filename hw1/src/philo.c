@@ -1,20 +1,53 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
 
 #include "global.h"
+#include "philo.h"
 #include "debug.h"
 
-#define MAX_TAXA 100
-#define MAX_NEWICK_SIZE 4096
-
-char taxa_names[MAX_TAXA][MAX_TAXA];
-int distance_matrix[MAX_TAXA][MAX_TAXA];
-int flags = 0; // Placeholder for flags
-int num_all_nodes = MAX_TAXA;
 char* outlier_name = NULL; // Placeholder for outlier name. This would be set based on user input
 
+OP_COUNTS op_counts;
+
 int compare(const char *str1, const char *str2);
 
+int counted_printf(FILE *out, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int ret = vfprintf(out, fmt, ap);
+    va_end(ap);
+    op_counts.write_calls++;
+    return ret;
+}
+
+int counted_putc(int c, FILE *out) {
+    op_counts.write_calls++;
+    return putc(c, out);
+}
+
+int counted_puts(const char *s, FILE *out) {
+    op_counts.write_calls++;
+    return fputs(s, out);
+}
+
+void *counted_malloc(size_t size) {
+    op_counts.allocations++;
+    return malloc(size);
+}
+
+void *counted_calloc(size_t count, size_t size) {
+    op_counts.allocations++;
+    return calloc(count, size);
+}
+
+void *counted_realloc(void *ptr, size_t size) {
+    op_counts.allocations++;
+    return realloc(ptr, size);
+}
+
 int parse_integer(const char *str, int *value) {
     int i = 0;
     *value = 0;
@@ -25,81 +58,344 @@ int parse_integer(const char *str, int *value) {
     return i;
 }
 
-// void append_to_newick(char* dest, const char* src) {
-//     while (*dest) {
-//         dest++
-//     }
-//     while (*src) {
-//         *dest = *src;
-//         dest++;
-//         src++;
-//     }
-//     *dest = '\0';
-// }
-
-// char* generate_newick_recursive(int node, char* buffer) {
-//     // If the node is a leaf, append its name to the buffer
-//     if (node < num_taxa) {
-//         append_to_newick(buffer, taxa_names[node]);
-//         return;
-//     }
-
-//     // Otherwise, it's an internal node. Recursively generate the Newick format for its children.
-//     char left_newick[MAX_NEWICK_SIZE] = {0};
-//     char right_newick[MAX_NEWICK_SIZE] = {0};
-//     generate_newick_recursive(nodes[node].neighbors[0]->index, left_newick);
-//     generate_newick_recursive(nodes[node].neighbors[1]->index, right_newick);
-
-//     // Calculate the distances to the children
-//     double left_distance = distances[node][nodes[node].neighbors[0]->index];
-//     double right_distance = distances[node][nodes[node].neighbors[1]->index];
-
-//     // Append the combined Newick formats of the children to the buffer
-//     append_to_newick(buffer, "(");
-//     append_to_newick(buffer, left_newick);
-//     char left_dist_str[20]; // Assuming distance won't exceed this length
-//     sprintf(left_dist_str, ":%.2f", left_distance);
-//     append_to_newick(buffer, left_dist_str);
-//     append_to_newick(buffer, ", ");
-//     append_to_newick(buffer, right_newick);
-//     char right_dist_str[20];
-//     sprintf(right_dist_str, ":%.2f", right_distance);
-//     append_to_newick(buffer, right_dist_str);
-//     append_to_newick(buffer, ")");
-// }
-
-void generate_newick_recursive(NODE *node, char *buffer, int *pos) {
-    if (node == NULL) return;
-
-    // If it's a leaf node
-    if (node->neighbors[1] == NULL && node->neighbors[2] == NULL) {
-        // Append the name of the leaf node to the buffer
-        int i = 0;
-        while (node->name[i] != '\0') {
-            buffer[*pos] = node->name[i];
-            (*pos)++;
-            i++;
+/*
+ * Emit the subtree rooted at node, arrived at from parent, in Newick form.
+ * Every node is labelled with its name and the length of the edge to its
+ * parent; the root (parent == NULL) has no edge length.
+ */
+static void emit_newick_subtree(FILE *out, NODE *node, NODE *parent, NODE *skip) {
+    int first = 1;
+    for (int k = 0; k < 3; k++) {
+        NODE *child = node->neighbors[k];
+        if (child == NULL || child == parent || child == skip)
+            continue;
+        counted_putc(first ? '(' : ',', out);
+        first = 0;
+        emit_newick_subtree(out, child, node, NULL);
+    }
+    if (!first)
+        counted_putc(')', out);
+    counted_puts(node->name, out);
+    if (parent != NULL) {
+        counted_printf(out, ":%.2f", distances[node - nodes][parent - nodes]);
+        op_counts.cells_touched++;
+    }
+}
+
+/*
+ * Give internal node u the name "#u" and point its NODE at the name.
+ * This is done for every join, so the number is formatted directly
+ * rather than with snprintf(), which costs more than the rest of a join
+ * on small inputs.
+ */
+void name_internal_node(int u) {
+    char digits[12];
+    char *name = node_names[u];
+    int len = 0;
+    for (int k = u; len == 0 || k > 0; k /= 10)
+        digits[len++] = '0' + k % 10;
+    *name++ = '#';
+    while (len > 0)
+        *name++ = digits[--len];
+    *name = '\0';
+    nodes[u].name = node_names[u];
+}
+
+/*
+ * Skip any comment lines (lines starting with '#') at the current
+ * position of the input stream.
+ */
+static void skip_comments(FILE *in) {
+    int c;
+    while ((c = getc(in)) == '#') {
+        while ((c = getc(in)) != '\n' && c != EOF)
+            ;
+    }
+    if (c != EOF)
+        ungetc(c, in);
+}
+
+/*
+ * Layouts of the distance matrix in the input, determined from the number
+ * of distances in the first data row.
+ */
+#define SQUARE 0       // every row has all N distances
+#define LOWER 1        // row i has the i distances before the diagonal
+#define LOWER_DIAG 2   // row i has the i+1 distances up to the diagonal
+
+/* Nonzero if the input being read is in PHYLIP format rather than CSV. */
+static int phylip_input;
+
+/*
+ * Nonzero if the name of the second row of PHYLIP input has already been
+ * read into input_buffer, while finding the end of the first row.
+ */
+static int name_pending;
+
+/* Number of distances in row r of a matrix with the given layout. */
+static int row_length(int layout, int r) {
+    return layout == SQUARE ? num_taxa : layout == LOWER ? r : r + 1;
+}
+
+/*
+ * Read one field directly from the input stream into input_buffer.
+ * The character that terminated the field (',', '\n' or EOF) is stored
+ * in *term.  A carriage return before the newline is dropped.  Fields are
+ * consumed as a stream, so there is no limit on the length of a line.
+ * If keep is zero the field is skipped without being stored.
+ * Returns the length of the field, or -1 if it is longer than INPUT_MAX.
+ */
+static int read_field(FILE *in, int keep, int *term) {
+    int c, len = 0;
+    while ((c = getc(in)) != ',' && c != '\n' && c != EOF) {
+        if (!keep)
+            continue;
+        if (len == INPUT_MAX)
+            return -1;
+        input_buffer[len++] = c;
+    }
+    if (c != ',' && len > 0 && input_buffer[len - 1] == '\r')
+        len--;
+    input_buffer[len] = '\0';
+    *term = c;
+    return len;
+}
+
+/*
+ * Read one whitespace-separated word of PHYLIP input into input_buffer,
+ * skipping any whitespace (including newlines) before it.  *term is set
+ * to ' ' if another word follows on the same line, '\n' if the word ends
+ * its line, or EOF if it ends the input.  If keep is zero the word is
+ * skipped without being stored.  Returns the length of the word (0 at the
+ * end of the input), or -1 if it is longer than INPUT_MAX.
+ */
+static int read_word(FILE *in, int keep, int *term) {
+    int c, len = 0;
+    while ((c = getc(in)) == ' ' || c == '\t' || c == '\r' || c == '\n')
+        ;
+    for (; c != EOF && c != ' ' && c != '\t' && c != '\r' && c != '\n'; c = getc(in)) {
+        if (!keep)
+            continue;
+        if (len == INPUT_MAX)
+            return -1;
+        input_buffer[len++] = c;
+    }
+    input_buffer[len] = '\0';
+    while (c == ' ' || c == '\t' || c == '\r')
+        c = getc(in);
+    if (c != '\n' && c != EOF) {
+        ungetc(c, in);
+        c = ' ';
+    }
+    *term = c;
+    return len;
+}
+
+/* Read the next field or word, according to the input format. */
+static int read_token(FILE *in, int keep, int *term) {
+    return phylip_input ? read_word(in, keep, term) : read_field(in, keep, term);
+}
+
+/*
+ * Read the CSV header line, which has an empty first field followed by
+ * the names of the taxa.
+ */
+static int read_csv_header(FILE *in) {
+    int term, len;
+    if ((len = read_field(in, 1, &term)) != 0) {
+        fprintf(stderr, len < 0 ? "Input field too long\n" : "First field of header must be empty\n");
+        return -1;
+    }
+    while (term == ',') {
+        if ((len = read_field(in, 1, &term)) < 0) {
+            fprintf(stderr, "Input field too long\n");
+            return -1;
         }
-        return;
+        if (num_taxa == MAX_TAXA) {
+            fprintf(stderr, "Too many taxa (maximum %d)\n", MAX_TAXA);
+            return -1;
+        }
+        memcpy(node_names[num_taxa++], input_buffer, len + 1);
+    }
+    if (num_taxa == 0) {
+        fprintf(stderr, "Missing taxa names\n");
+        return -1;
     }
+    return 0;
+}
+
+/*
+ * Read the PHYLIP header line, which holds just the number of taxa.
+ */
+static int read_phylip_header(FILE *in) {
+    int term, len, n;
+    if ((len = read_word(in, 1, &term)) < 0 || len == 0
+        || parse_integer(input_buffer, &n) != len || term == ' ') {
+        fprintf(stderr, "Invalid PHYLIP header\n");
+        return -1;
+    }
+    if (n == 0 || n > MAX_TAXA) {
+        fprintf(stderr, n == 0 ? "Missing taxa names\n" : "Too many taxa (maximum %d)\n", MAX_TAXA);
+        return -1;
+    }
+    num_taxa = n;
+    return 0;
+}
 
-    // If it's an internal node
-    buffer[*pos] = '(';
-    (*pos)++;
+/*
+ * Read the name at the start of row r.  In CSV input it must match the
+ * name in the corresponding column of the header; in PHYLIP input it
+ * defines the name of the taxon.
+ */
+static int read_row_name(FILE *in, int r, int *term) {
+    int len;
+    if (!phylip_input)
+        skip_comments(in);
+    if (name_pending) {
+        name_pending = 0;
+        len = strlen(input_buffer);
+    } else if ((len = read_token(in, 1, term)) < 0) {
+        fprintf(stderr, "Input field too long\n");
+        return -1;
+    }
+    if (*term == EOF && len == 0) {
+        fprintf(stderr, "Premature end of distance data\n");
+        return -1;
+    }
+    if (phylip_input) {
+        memcpy(node_names[r], input_buffer, len + 1);
+    } else if (strcmp(input_buffer, node_names[r]) != 0) {
+        fprintf(stderr, "Row %d name '%s' does not match column name '%s'\n",
+                r + 1, input_buffer, node_names[r]);
+        return -1;
+    }
+    return 0;
+}
 
-    // Recur for the first child
-    generate_newick_recursive(node->neighbors[1], buffer, pos);
+/*
+ * Convert the text of a distance to a number.  Only finite decimal
+ * numbers are accepted: strtod() also takes hexadecimal numbers and the
+ * words "inf" and "nan", none of which is a usable distance.  Returns 0
+ * if s is a distance, otherwise -1.
+ */
+static int parse_distance(const char *s, double *value) {
+    char *end;
+    if (*s == '\0' || strpbrk(s, "xX") != NULL)
+        return -1;
+    *value = strtod(s, &end);
+    return *end == '\0' && isfinite(*value) ? 0 : -1;
+}
 
-    buffer[*pos] = ',';
-    (*pos)++;
+/*
+ * Read the next distance of row r into *value.
+ */
+static int read_distance(FILE *in, int r, double *value, int *term) {
+    int len = read_token(in, 1, term);
+    if (len < 0) {
+        fprintf(stderr, "Input field too long\n");
+        return -1;
+    }
+    if (len == 0 && *term == EOF) {
+        fprintf(stderr, "Premature end of distance data\n");
+        return -1;
+    }
+    if (parse_distance(input_buffer, value) != 0) {
+        fprintf(stderr, "Invalid distance '%s' in row %d\n", input_buffer, r + 1);
+        return -1;
+    }
+    return 0;
+}
 
-    // Recur for the second child
-    generate_newick_recursive(node->neighbors[2], buffer, pos);
+/*
+ * Validate the distance d read for column c of row r, store it and add it
+ * to the row sums.  If mirror is nonzero the distance is also stored in
+ * row c, in place of the entry that is not read; otherwise it is checked
+ * against that entry if it has already been read.  Row sums are
+ * accumulated in column order either way (row c's share of a mirrored
+ * distance arrives in the order in which the rows are read), so they are
+ * the same as if each completed row were summed.
+ */
+static int store_distance(int r, int c, double d, int mirror) {
+    if (c == r && d != 0.0) {
+        fprintf(stderr, "Nonzero diagonal entry for taxon %s\n", node_names[r]);
+        return -1;
+    }
+    distances[r][c] = d;
+    op_counts.cells_touched++;
+    row_sums[r] += d;
+    if (mirror && c != r) {
+        distances[c][r] = d;
+        op_counts.cells_touched++;
+        row_sums[c] += d;
+    } else if (!mirror && c < r) {
+        op_counts.cells_touched++;
+        if (distances[c][r] != d) {
+            fprintf(stderr, "Distance matrix is not symmetric (%s, %s)\n",
+                    node_names[r], node_names[c]);
+            return -1;
+        }
+    }
+    return 0;
+}
 
-    buffer[*pos] = ')';
-    (*pos)++;
+/*
+ * Read and store the distances of the first row of PHYLIP input, whose
+ * layout is not known yet.  Since a row may be continued on the following
+ * lines, its length is found by reading words up to the next name, the
+ * first word that is not a number, which is left for read_row_name().
+ * At most N distances are read; a row of N ends without a name after it.
+ * Returns the number of distances read, or -1 if there was an error.
+ */
+static int read_phylip_first_row(FILE *in, int *term) {
+    char *end;
+    int col = 0, len;
+    while (col < num_taxa) {
+        if ((len = read_word(in, 1, term)) < 0) {
+            fprintf(stderr, "Input field too long\n");
+            return -1;
+        }
+        if (len == 0)
+            break;
+        double d = strtod(input_buffer, &end);
+        if (*end != '\0') {
+            name_pending = 1;
+            break;
+        }
+        if (parse_distance(input_buffer, &d) != 0) {
+            fprintf(stderr, "Invalid distance '%s' in row 1\n", input_buffer);
+            return -1;
+        }
+        if (store_distance(0, col++, d, 0) != 0)
+            return -1;
+    }
+    return col;
 }
 
+/*
+ * Read and store distances col..count-1 of row r, where *term is the
+ * terminator of the token before them.  The first skip distances are
+ * passed over without being parsed.  In CSV input the distances must all
+ * be on the line of the row name; in PHYLIP input a row may be continued
+ * on the following lines.
+ */
+static int read_row(FILE *in, int r, int col, int count, int skip, int mirror, int *term) {
+    double d;
+    for (; col < count; col++) {
+        if (phylip_input ? *term == EOF : *term != ',') {
+            fprintf(stderr, "Row %d has the wrong number of fields\n", r + 1);
+            return -1;
+        }
+        if (col < skip)
+            read_token(in, 0, term);
+        else if (read_distance(in, r, &d, term) != 0 || store_distance(r, col, d, mirror) != 0)
+            return -1;
+    }
+    if (!phylip_input && *term == ',') {
+        fprintf(stderr, "Row %d has the wrong number of fields\n", r + 1);
+        return -1;
+    }
+    return 0;
+}
 
 /**
  * @brief  Read genetic distance data and initialize data structures.
@@ -128,6 +424,30 @@ void generate_newick_recursive(NODE *node, char *buffer, int *pos) {
  * matrix (i.e. D[i][j] == D[j][i]) with zeroes on the main diagonal
  * (i.e. D[i][i] == 0).
  *
+ * The matrix may also be given in lower-triangular form, in which the
+ * line for the i-th taxon (counting from 0) has only the i distances to
+ * the taxa before it, optionally followed by its zero diagonal entry.
+ * Which form is used is determined from the first data line, which then
+ * has no distances or a single one.  Each distance of a triangular matrix
+ * is parsed once and stored in both halves of the distances matrix.  If
+ * the TRUST_SYMMETRIC_OPTION bit is set in global_options, the entries
+ * below the diagonal of a square matrix are skipped without being parsed
+ * and taken from the entries above it.
+ *
+ * Input in PHYLIP format is recognized by a first data line that holds
+ * the number N of taxa instead of an empty field.  It is followed by
+ * N rows, each consisting of a taxon name and its distances, in square or
+ * either lower-triangular form, separated by whitespace.  Names are not
+ * limited to ten characters (relaxed PHYLIP) and a row may be continued
+ * on following lines (interleaved).  The layout is given by the number of
+ * distances before the second name, which is the first word that is not a
+ * number, so in lower-triangular PHYLIP input names may not be numbers.
+ *
+ * Input is tokenized field by field as it is read, so lines may be of any
+ * length.  Input that starts with a gzip or zstd magic number is
+ * decompressed by a concurrent child process (see decompress.c) and
+ * parsed as the decompressed data arrives.
+ *
  * If 0 is returned, indicating data successfully read, then upon return
  * the following global variables and data structures have been set:
  *   num_taxa - set to the number N of taxa, determined from the first data line
@@ -141,6 +461,7 @@ void generate_newick_recursive(NODE *node, char *buffer, int *pos) {
  *     array.
  *   active_node_map - initialized to the identity mapping on [0..N);
  *     that is, active_node_map[i] == i for 0 <= i < N.
+ *   row_sums - the first N entries contain the sums of the rows of distances.
  *
  * @param in  The input stream from which to read the data.
  * @return 0 in case the data was successfully read, otherwise -1
@@ -151,39 +472,84 @@ void generate_newick_recursive(NODE *node, char *buffer, int *pos) {
  */
 
 int read_distance_data(FILE *in) {
-    char line[1024];
-    int row = 0;
-
-    // Read the first line for taxa names
-    if (fgets(line, sizeof(line), in) != NULL) {
-        int i = 0, j = 0, k = 0;
-        while (line[i] != '\0') {
-            if (line[i] == ',' || line[i] == '\n') {
-                taxa_names[j][k] = '\0';
-                j++;
-                k = 0;
-                i++;
-            } else {
-                taxa_names[j][k++] = line[i++];
-            }
-        }
+    int term, c;
+
+    // Compressed input is inflated by a child process and parsed as it streams in
+    if (is_compressed_input(in)) {
+        FILE *dec = open_decompressed(in);
+        if (dec == NULL)
+            return -1;
+        int ret = read_distance_data(dec);
+        if (close_decompressed(dec) != 0)
+            ret = -1;
+        return ret;
     }
 
-    // Read the distance matrix
-    while (fgets(line, sizeof(line), in) != NULL) {
-        int i = 0, col = 0, value;
-        while (line[i] != '\0') {
-            if (line[i] == ',' || line[i] == '\n') {
-                i++;
+    // The header is a line of taxa names (CSV) or the number of taxa (PHYLIP)
+    num_taxa = 0;
+    name_pending = 0;
+    skip_comments(in);
+    if ((c = getc(in)) != EOF)
+        ungetc(c, in);
+    phylip_input = c == ' ' || c == '\t' || (c >= '0' && c <= '9');
+    if ((phylip_input ? read_phylip_header(in) : read_csv_header(in)) != 0)
+        return -1;
+
+    // Read the distance matrix.  Each distance is validated and added to
+    // the row sums as it is parsed, so build_taxonomy() can start joining
+    // as soon as the last one is in.
+    int layout = SQUARE;
+    int trust = (global_options & TRUST_SYMMETRIC_OPTION) != 0;
+    int mirror = 0;
+    for (int row = 0; row < num_taxa; row++)
+        row_sums[row] = 0.0;
+    for (int row = 0; row < num_taxa; row++) {
+        if (read_row_name(in, row, &term) != 0)
+            return -1;
+        int col = 0;
+        double d;
+        if (row == 0) {
+            // The number of distances in the first row gives the layout: in
+            // CSV those on its line, in PHYLIP those before the next name
+            if (phylip_input) {
+                if ((col = read_phylip_first_row(in, &term)) < 0)
+                    return -1;
             } else {
-                i += parse_integer(&line[i], &value);
-                distance_matrix[row][col++] = value;
+                while (term == ',' && col < num_taxa) {
+                    if (read_distance(in, 0, &d, &term) != 0 || store_distance(0, col++, d, 0) != 0)
+                        return -1;
+                }
+            }
+            layout = col == 0 ? LOWER : col == 1 && num_taxa > 1 ? LOWER_DIAG : SQUARE;
+            if (name_pending && col < row_length(layout, 0)) {
+                fprintf(stderr, "Row 1 has the wrong number of fields\n");
+                return -1;
+            }
+
+            // Each distance read is mirrored into the half that is not read
+            mirror = layout != SQUARE || trust;
+            for (int c = 1; mirror && c < col; c++) {
+                distances[c][0] = distances[0][c];
+                row_sums[c] += distances[0][c];
+                op_counts.cells_touched += 2;
             }
         }
-        row++;
+        int count = row_length(layout, row);
+        int skip = layout == SQUARE && trust ? row : 0;
+        if (read_row(in, row, col, count, skip, mirror, &term) != 0)
+            return -1;
+        if (layout == LOWER) {
+            distances[row][row] = 0.0;
+            op_counts.cells_touched++;
+        }
     }
 
-    // TODO: Add error handling and validation
+    num_all_nodes = num_taxa;
+    num_active_nodes = num_taxa;
+    for (int i = 0; i < num_taxa; i++) {
+        nodes[i].name = node_names[i];
+        active_node_map[i] = i;
+    }
 
     return 0;
 }
@@ -221,55 +587,47 @@ int read_distance_data(FILE *in) {
  * in the tree.
  */
 int emit_newick_format(FILE *out) {
-    char newick_str[MAX_NEWICK_SIZE] = {0}; // Static buffer for Newick string
-    int pos = 0;
-
-    // Find the root node (it could be any node based on your logic)
-    NODE *root = &nodes[0]; // Assuming nodes[0] is the root
+    int outlier = -1;
 
-    generate_newick_recursive(root, newick_str, &pos);
-
-    newick_str[pos] = ';';
-    newick_str[pos + 1] = '\0';
+    if (outlier_name != NULL) {
+        for (int i = 0; i < num_taxa; i++) {
+            if (compare(node_names[i], outlier_name) == 0) {
+                outlier = i;
+                break;
+            }
+        }
+        if (outlier == -1) {
+            fprintf(stderr, "No leaf named '%s'\n", outlier_name);
+            return -1;
+        }
+    } else {
+        // Leaf-to-leaf distances are never overwritten by the tree builders
+        double max_distance = -1.0;
+        for (int i = 0; i < num_taxa; i++) {
+            double total = 0.0;
+            for (int j = 0; j < num_taxa; j++) {
+                total += distances[i][j];
+                op_counts.cells_touched++;
+            }
+            if (total > max_distance) {
+                max_distance = total;
+                outlier = i;
+            }
+        }
+    }
+    if (outlier == -1)
+        return -1;
 
-    fprintf(out, "%s\n", newick_str);
+    NODE *root = nodes[outlier].neighbors[0];
+    if (root == NULL)
+        emit_newick_subtree(out, &nodes[outlier], NULL, NULL);
+    else
+        emit_newick_subtree(out, root, NULL, &nodes[outlier]);
+    counted_puts(";\n", out);
 
     return 0;
 }
 
-// int emit_newick_format(FILE *out) {
-//     int outlier_node = -1;
-//     char newick_str[MAX_NEWICK_SIZE] = {0}; // Static buffer for Newick string
-//     if (outlier_name) {
-//         // Find the node with the outlier_name
-//         for (int i = 0; i < num_all_nodes; i++) {
-//             if (compare(taxa_names[i], outlier_name) == 0) {
-//                 outlier_node = i;
-//                 break;
-//             }
-//         }
-//         if (outlier_node == -1) return -1; // Error if no node with outlier_name exists
-//     } else {
-//         // Determine the outlier node based on the greatest total distance to other leaves
-//         int max_distance = -1;
-//         for (int i = 0; i < num_all_nodes; i++) {
-//             int current_distance = 0;
-//             for (int j = 0; j < num_all_nodes; j++) {
-//                 current_distance += distance_matrix[i][j];
-//             }
-//             if (current_distance > max_distance) {
-//                 max_distance = current_distance;
-//                 outlier_node = i;
-//             }
-//         }
-//     }
-
-//     if (newick_str[0] != '\0') {
-//         fprintf(out, "%s;\n", newick_str);
-//     }
-//     return 0;
-// }
-
 /**
  * @brief  Emit the synthesized distance matrix as CSV.
  * @details  This function emits to a specified output stream a representation
@@ -288,13 +646,16 @@ int emit_newick_format(FILE *out) {
  * if any error occurred.
  */
 int emit_distance_matrix(FILE *out) {
+    for (int j = 0; j < num_all_nodes; j++)
+        counted_printf(out, ",%s", node_names[j]);
+    counted_putc('\n', out);
     for (int i = 0; i < num_all_nodes; i++) {
+        counted_puts(node_names[i], out);
         for (int j = 0; j < num_all_nodes; j++) {
-            fprintf(out, "%d", distance_matrix[i][j]);
-            if (j < num_all_nodes - 1) {
-                fprintf(out, ",");  // Add comma for CSV format except for the last column
-            }
+            counted_printf(out, ",%.2f", distances[i][j]);
+            op_counts.cells_touched++;
         }
+        counted_putc('\n', out);
     }
     return 0;
 }
@@ -345,76 +706,133 @@ int emit_distance_matrix(FILE *out) {
  * if any error occurred.
  */
 int build_taxonomy(FILE *out) {
-    // Initialization
-    int total_distances[MAX_TAXA] = {0};
-    for (int i = 0; i < MAX_TAXA; i++) {
-        for (int j = 0; j < MAX_TAXA; j++) {
-            total_distances[i] += distance_matrix[i][j];
-        }
+    int n = num_active_nodes;
+
+    // Row sums were accumulated by read_distance_data(); from here on they
+    // are maintained incrementally.
+    for (int a = 0; a < n; a++) {
+        int i = active_node_map[a];
+        nodes[i].neighbors[0] = nodes[i].neighbors[1] = nodes[i].neighbors[2] = NULL;
     }
 
-    // Main loop for the neighbor joining algorithm
-    int N = MAX_TAXA; // Number of remaining taxa
-    while (N > 2) {
-        // Find the pair of taxa to join
-        int min_i = -1, min_j = -1;
-        double min_distance = 1.0e30; // A large initial value
-        for (int i = 0; i < N; i++) {
-            for (int j = i + 1; j < N; j++) {
-                double reduced_distance = distance_matrix[i][j] - (double)(total_distances[i] + total_distances[j]) / (N - 2);
-                if (reduced_distance < min_distance) {
-                    min_distance = reduced_distance;
-                    min_i = i;
-                    min_j = j;
+    while (n > 2) {
+        // Scan for the pair minimizing Q(i,j) = (n-2)d(i,j) - S(i) - S(j).
+        // This is the only full read of the active submatrix per iteration.
+        int min_a = 0, min_b = 1;
+        double min_q = 0.0;
+        for (int a = 0; a < n; a++) {
+            int i = active_node_map[a];
+            double *di = distances[i];
+            double si = row_sums[i];
+            for (int b = a + 1; b < n; b++) {
+                int j = active_node_map[b];
+                double q = (n - 2) * di[j] - si - row_sums[j];
+                op_counts.q_evaluations++;
+                op_counts.cells_touched++;
+                if ((a == 0 && b == 1) || q < min_q) {
+                    min_q = q;
+                    min_a = a;
+                    min_b = b;
                 }
             }
         }
-        // Calculate the branch lengths and update the distance matrix
-        double branch_length_i = (distance_matrix[min_i][min_j] + (double)(total_distances[min_i] - total_distances[min_j]) / (N - 2)) / 2;
-        double branch_length_j = distance_matrix[min_i][min_j] - branch_length_i;
-
-        // Update the distance matrix
-        for (int k = 0; k < N; k++) {
-            if (k != min_i && k != min_j) {
-                double new_distance = (distance_matrix[min_i][k] + distance_matrix[min_j][k] - distance_matrix[min_i][min_j]) / 2;
-                distance_matrix[min_i][k] = new_distance;
-                distance_matrix[k][min_i] = new_distance;
-            }
-        }
-        // Remove min_j from the matrix by shifting rows and columns
-        for (int k = min_j; k < N - 1; k++) {
-            total_distances[k] = total_distances[k + 1];
-            for (int l = 0; l < N; l++) {
-                distance_matrix[k][l] = distance_matrix[k + 1][l];
-                distance_matrix[l][k] = distance_matrix[l][k + 1];
-            }
-        }
-        N--;
-    }
 
-    // Output the resulting tree or matrix based on flags
-    if (flags & 0x1) { // 0x1 represents the -m flag
-        //Output the matrix of estimated distances
-        for (int i = 0; i < N; i++) {
-            for (int j = 0; j < N; j++) {
-                fprintf(out, "%d", distance_matrix[i][j]);
-            }
-            fprintf(out, "\n");
+        int i = active_node_map[min_a];
+        int j = active_node_map[min_b];
+        int u = num_all_nodes++;
+        double dij = distances[i][j];
+        op_counts.cells_touched++;
+        double li = dij / 2 + (row_sums[i] - row_sums[j]) / (2 * (n - 2));
+        double lj = dij - li;
+
+        name_internal_node(u);
+        nodes[u].neighbors[0] = NULL;
+        nodes[u].neighbors[1] = &nodes[i];
+        nodes[u].neighbors[2] = &nodes[j];
+        nodes[i].neighbors[0] = &nodes[u];
+        nodes[j].neighbors[0] = &nodes[u];
+
+        // Fused update: write the new node's row/column and adjust the
+        // row sums of the remaining nodes in a single pass over rows i and j.
+        double *di = distances[i], *dj = distances[j], *du = distances[u];
+        double su = 0.0;
+        for (int c = 0; c < n; c++) {
+            int k = active_node_map[c];
+            if (k == i || k == j) continue;
+            double dik = di[k], djk = dj[k];
+            double duk = (dik + djk - dij) / 2;
+            du[k] = duk;
+            distances[k][u] = duk;
+            row_sums[k] += duk - dik - djk;
+            su += duk;
+            op_counts.cells_touched += 4;
         }
-    } else {
-        // Output the edges (default behavior)
-        for (int i = 0; i < N; i++) {
-            for (int j = i + 1; j < N; j++) {
-                fprintf(out, "%s  %s %d\n", taxa_names[i], taxa_names[j], distance_matrix[i][j]);
-            }
+        du[u] = 0.0;
+        du[i] = distances[i][u] = li;
+        du[j] = distances[j][u] = lj;
+        row_sums[u] = su;
+        op_counts.cells_touched += 5;
+
+        if (out != NULL) {
+            counted_printf(out, "%s,%s,%.2f\n", node_names[i], node_names[u], li);
+            counted_printf(out, "%s,%s,%.2f\n", node_names[j], node_names[u], lj);
         }
+
+        // Retire i and j in O(1): u takes i's slot, the last active node
+        // takes j's slot.  No rows or columns of the matrix are moved.
+        active_node_map[min_a] = u;
+        op_counts.bytes_moved += sizeof(int);
+        active_node_map[min_b] = active_node_map[n - 1];
+        op_counts.bytes_moved += sizeof(int);
+        n--;
+    }
+    num_active_nodes = n;
+
+    if (n == 2) {
+        int i = active_node_map[0];
+        int j = active_node_map[1];
+        nodes[i].neighbors[0] = &nodes[j];
+        nodes[j].neighbors[0] = &nodes[i];
+        if (out != NULL)
+            counted_printf(out, "%s,%s,%.2f\n", node_names[i], node_names[j], distances[i][j]);
     }
 
-    // for (int i = 0; i < N; i++) {
-    //     for (int j = i + 1; j < N; j++) {
-    //         fprintf(out, "%s %s %d\n", taxa_names[i], taxa_names[j], distance_matrix[i][j]);
-    //     }
-    // }
+    return 0;
+}
 
+/**
+ * @brief  Read distance data, build a tree and emit the result selected
+ * by global_options.
+ * @details  This performs one complete run of the program on the given
+ * streams: read_distance_data() on the input, then build_taxonomy() or
+ * build_upgma() according to the clustering option, then either the edge
+ * data (written as the tree is built), emit_distance_matrix() or
+ * emit_newick_format().  It is used both by main() and by the workers of
+ * the server started with -s.
+ *
+ * @param in  The input stream from which to read the distance data.
+ * @param out  The output stream to which to write the result.
+ * @return 0 in case of success, otherwise -1 if any error occurred.
+ */
+int run_taxonomy(FILE *in, FILE *out) {
+    FILE *edges = (global_options & (MATRIX_OPTION | NEWICK_OPTION)) ? NULL : out;
+    int ret;
+
+    if (read_distance_data(in))
+        return -1;
+
+    if (global_options & UPGMA_OPTION)
+        ret = build_upgma(edges, 0);
+    else if (global_options & WPGMA_OPTION)
+        ret = build_upgma(edges, 1);
+    else
+        ret = build_taxonomy(edges);
+    if (ret)
+        return -1;
+
+    if (global_options & MATRIX_OPTION)
+        return emit_distance_matrix(out);
+    if (global_options & NEWICK_OPTION)
+        return emit_newick_format(out);
     return 0;
 }
@@ -0,0 +1,437 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "global.h"
+#include "philo.h"
+#include "debug.h"
+
+/*
+ * Protocol
+ *
+ * A request starts with a line holding the number of options for the run,
+ * followed by each option on a line of its own, so that an option (such
+ * as a taxon name given with -o) may contain spaces.  For example,
+ * the options -n -o 'Homo sapiens' are sent as "3\n-n\n-o\nHomo sapiens\n".
+ * The distance data follows the last option.
+ * The client shuts down its side of the connection after the data.
+ * A request that has not been received in full within REQUEST_TIMEOUT
+ * seconds fails, so that a stalled client cannot hold a worker.
+ * The response consists of a line "<status> <length>", where status is
+ * 0 for success or 1 for failure, followed by <length> bytes that are the
+ * program output on success or the error messages on failure.
+ */
+
+/* Maximum total length of the options of a request. */
+#define REQUEST_TEXT_MAX 1024
+
+/* Maximum number of options in a request. */
+#define REQUEST_ARGS_MAX 16
+
+/* Seconds a worker waits for the whole of a request. */
+#define REQUEST_TIMEOUT 2
+
+/* Upper limit on the number of worker processes. */
+#define MAX_WORKERS 64
+
+/*
+ * Exit status of a worker that failed before serving any request.  After
+ * MAX_START_FAILURES of these in a row the server gives up instead of
+ * restarting workers that cannot run.
+ */
+#define WORKER_START_FAILED 3
+#define MAX_START_FAILURES 5
+
+/* Path of the socket given with -s or -c, set by validargs. */
+char *socket_path;
+
+int compare(const char *str1, const char *str2);
+int parse_integer(const char *str, int *value);
+
+static volatile sig_atomic_t shutting_down = 0;
+
+static void handle_shutdown(int sig) {
+    shutting_down = 1;
+}
+
+/* Connection of the request being handled, and whether it timed out. */
+static volatile sig_atomic_t request_fd = -1;
+static volatile sig_atomic_t request_timed_out = 0;
+
+/*
+ * When a request is not received in time, end the input side of its
+ * connection.  Every read of it then sees end of file at once, including
+ * those of a process feeding a decompressor, so the request fails without
+ * waiting on the client again.
+ */
+static void handle_timeout(int sig) {
+    request_timed_out = 1;
+    if (request_fd != -1)
+        shutdown(request_fd, SHUT_RD);
+}
+
+/* Write all of a buffer to a socket, without raising SIGPIPE. */
+static int send_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Maximum length of the error messages returned for a failed request. */
+#define ERROR_TEXT_MAX 4096
+
+/*
+ * Clear the part of the distances matrix used by the previous request.
+ * build_taxonomy() writes the distances from each new internal node only
+ * to the nodes still active, so the entries between it and nodes retired
+ * earlier would otherwise keep the values of an earlier request and show
+ * up in the output of -m.
+ */
+static void clear_distances(void) {
+    int used = num_all_nodes > num_taxa ? num_all_nodes : num_taxa;
+    for (int i = 0; i < used; i++)
+        memset(distances[i], 0, used * sizeof(double));
+}
+
+/*
+ * Read the options of a request into args[1..], with their text stored in
+ * text.  Returns the number of options, or -1 if the request is malformed
+ * or has too many options.
+ */
+static int read_options(FILE *in, char **args, char *text) {
+    char *end = text + REQUEST_TEXT_MAX;
+    int count, len;
+    if (fgets(text, REQUEST_TEXT_MAX, in) == NULL || strchr(text, '\n') == NULL
+        || (len = parse_integer(text, &count)) == 0 || text[len] != '\n') {
+        fprintf(stderr, "Malformed request\n");
+        return -1;
+    }
+    if (len > 2 || count > REQUEST_ARGS_MAX) {
+        fprintf(stderr, "Too many options in request (maximum %d)\n", REQUEST_ARGS_MAX);
+        return -1;
+    }
+    for (int k = 1; k <= count; k++) {
+        char *nl;
+        if (end - text < 2 || fgets(text, end - text, in) == NULL
+            || (nl = strchr(text, '\n')) == NULL) {
+            fprintf(stderr, "Malformed request\n");
+            return -1;
+        }
+        *nl = '\0';
+        args[k] = text;
+        text = nl + 1;
+    }
+    return count;
+}
+
+/*
+ * Handle a single request on a connected socket.  Output is collected in
+ * a memory stream and error messages in the temporary file that the
+ * worker's stderr refers to, so that the response can be sent with its
+ * length up front.
+ */
+static void handle_request(int fd, FILE *out, char **outbuf) {
+    char text[REQUEST_TEXT_MAX];
+    char *args[REQUEST_ARGS_MAX + 2] = {"philo"};
+    int argc, status = 1;
+    FILE *in = fdopen(dup(fd), "r");
+
+    // Start each request with empty output and error text, and with no
+    // distances left over from the previous one
+    rewind(out);
+    if (ftruncate(STDERR_FILENO, 0) == 0)
+        lseek(STDERR_FILENO, 0, SEEK_SET);
+    clear_distances();
+    request_timed_out = 0;
+    request_fd = fd;
+    alarm(REQUEST_TIMEOUT);
+
+    if (in == NULL) {
+        fprintf(stderr, "Malformed request\n");
+    } else if ((argc = read_options(in, args, text)) >= 0) {
+        argc++;
+        args[argc] = NULL;
+        if (validargs(argc, args) != 0
+            || (global_options & (HELP_OPTION | COMPARE_OPTION | SERVE_OPTION | CLIENT_OPTION))) {
+            fprintf(stderr, "Invalid options in request\n");
+        } else if (run_taxonomy(in, out) == 0) {
+            status = 0;
+        }
+    }
+    if (in != NULL) {
+        // Consume any trailing input, so the client is never left blocked
+        // sending while the response is written
+        while (getc(in) != EOF)
+            ;
+        fclose(in);
+    }
+    alarm(0);
+    request_fd = -1;
+    if (status != 0 && request_timed_out) {
+        // The errors reported for the incomplete input would only mislead
+        fflush(stderr);
+        if (ftruncate(STDERR_FILENO, 0) == 0)
+            lseek(STDERR_FILENO, 0, SEEK_SET);
+        fprintf(stderr, "Request not received within %d seconds\n", REQUEST_TIMEOUT);
+    }
+
+    char header[64];
+    char errors[ERROR_TEXT_MAX];
+    char *body = errors;
+    size_t len = 0;
+    fflush(stderr);
+    if (status == 0) {
+        fflush(out);
+        len = ftell(out);
+        body = *outbuf;
+    } else {
+        ssize_t n = pread(STDERR_FILENO, errors, sizeof(errors), 0);
+        len = n > 0 ? n : 0;
+    }
+    int hlen = snprintf(header, sizeof(header), "%d %zu\n", status, len);
+    if (send_all(fd, header, hlen) == 0)
+        send_all(fd, body, len);
+}
+
+/*
+ * Main loop of a worker process.  The worker's copy of the static tree
+ * data is touched once up front, so no request pays for page faults on it,
+ * and is then reused for every request the worker accepts.
+ */
+static void worker(int listen_fd) {
+    char *outbuf = NULL;
+    size_t outsize = 0;
+    long served = 0;
+    struct sigaction sa;
+    FILE *err = tmpfile();
+    FILE *out = open_memstream(&outbuf, &outsize);
+
+    // Reads interrupted by the timeout are restarted, and then see the
+    // end of the input
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_timeout;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (err == NULL || out == NULL || dup2(fileno(err), STDERR_FILENO) == -1
+        || sigaction(SIGALRM, &sa, NULL) == -1)
+        _exit(WORKER_START_FAILED);
+    memset(distances, 0, sizeof(distances));
+    memset(node_names, 0, sizeof(node_names));
+    memset(nodes, 0, sizeof(nodes));
+    memset(row_sums, 0, sizeof(row_sums));
+    memset(active_node_map, 0, sizeof(active_node_map));
+
+    while (!shutting_down) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            _exit(served ? EXIT_FAILURE : WORKER_START_FAILED);
+        }
+        handle_request(fd, out, &outbuf);
+        close(fd);
+        served++;
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+static pid_t start_worker(int listen_fd) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        worker(listen_fd);
+    }
+    return pid;
+}
+
+/**
+ * @brief  Run a server that builds trees for requests on a Unix domain socket.
+ * @details  A socket is created at the given path, which may only name a
+ * socket left by an earlier server or nothing at all, and a pool of worker
+ * processes, one per online processor, is started.  Each worker is an
+ * independent copy of the program with its own (already faulted-in)
+ * global tree data; the workers accept connections on the shared socket,
+ * so requests are processed concurrently without a process being started
+ * per request.  A worker that exits is replaced, after a pause if it exited
+ * before serving any request.  The server runs until it receives SIGINT or
+ * SIGTERM, or until MAX_START_FAILURES workers in a row have failed to
+ * start, at which point the workers are terminated and the socket is
+ * removed.  See the protocol description at the top of this file.
+ *
+ * @param path  The path at which to create the socket.
+ * @return 0 if the server shut down normally, otherwise -1.
+ */
+int serve(char *path) {
+    struct sockaddr_un addr;
+    struct sigaction sa;
+    struct stat st;
+    pid_t workers[MAX_WORKERS];
+    long num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    if (num_workers < 1)
+        num_workers = 1;
+    if (num_workers > MAX_WORKERS)
+        num_workers = MAX_WORKERS;
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    // Only a socket left by an earlier server is replaced, never another file
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path);
+    if (listen_fd == -1 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1
+        || listen(listen_fd, SOMAXCONN) == -1) {
+        fprintf(stderr, "Unable to listen on %s\n", path);
+        return -1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_shutdown;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    fflush(stdout);
+    for (int k = 0; k < num_workers; k++)
+        workers[k] = start_worker(listen_fd);
+
+    int start_failures = 0, ret = 0;
+    while (!shutting_down) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid == -1)
+            continue;
+        // A worker that cannot even start would otherwise be restarted in
+        // a tight loop; pause before each restart and give up eventually.
+        if (WIFEXITED(status) && WEXITSTATUS(status) == WORKER_START_FAILED) {
+            if (++start_failures == MAX_START_FAILURES) {
+                fprintf(stderr, "Workers failed to start %d times in a row\n", start_failures);
+                shutting_down = 1;
+                ret = -1;
+            } else {
+                sleep(1);
+            }
+        } else {
+            start_failures = 0;
+        }
+        for (int k = 0; k < num_workers; k++)
+            if (workers[k] == pid)
+                workers[k] = shutting_down ? 0 : start_worker(listen_fd);
+    }
+
+    for (int k = 0; k < num_workers; k++)
+        if (workers[k] > 0)
+            kill(workers[k], SIGTERM);
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR)
+        ;
+    close(listen_fd);
+    unlink(path);
+    return ret;
+}
+
+/**
+ * @brief  Have a server started with -s build a tree for the standard input.
+ * @details  The options on the command line other than -c and its argument
+ * are sent to the server as the options for the request, followed by the
+ * contents of the standard input.  The output of the server is copied to
+ * the standard output, or its error messages to the standard error.
+ *
+ * @param path  The path of the server's socket.
+ * @param argc  The number of command-line arguments.
+ * @param argv  The command-line arguments.
+ * @return EXIT_SUCCESS if the server processed the request successfully,
+ * otherwise EXIT_FAILURE.
+ */
+int client(char *path, int argc, char **argv) {
+    struct sockaddr_un addr;
+    char buf[1 << 16];
+    size_t n;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return EXIT_FAILURE;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (fd == -1 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        fprintf(stderr, "Unable to connect to %s\n", path);
+        return EXIT_FAILURE;
+    }
+
+    // Options: everything except -c <socket>, one per line after their count
+    size_t len = snprintf(buf, sizeof(buf), "%d\n", argc - 3);
+    size_t text_len = 0;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && argv[i + 1] == path && compare(argv[i], "-c") == 0) {
+            i++;
+            continue;
+        }
+        if (strchr(argv[i], '\n') != NULL) {
+            fprintf(stderr, "Option contains a newline\n");
+            close(fd);
+            return EXIT_FAILURE;
+        }
+        text_len += strlen(argv[i]) + 1;
+        if (argc - 3 > REQUEST_ARGS_MAX || text_len >= REQUEST_TEXT_MAX) {
+            fprintf(stderr, "Too many options\n");
+            close(fd);
+            return EXIT_FAILURE;
+        }
+        len += snprintf(buf + len, sizeof(buf) - len, "%s\n", argv[i]);
+    }
+    if (send_all(fd, buf, len) != 0) {
+        fprintf(stderr, "Error sending request\n");
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    while ((n = fread(buf, 1, sizeof(buf), stdin)) > 0) {
+        // The server stops reading after the last data line
+        if (send_all(fd, buf, n) != 0)
+            break;
+    }
+    shutdown(fd, SHUT_WR);
+
+    FILE *resp = fdopen(fd, "r");
+    int status;
+    size_t length;
+    if (resp == NULL || fscanf(resp, "%d %zu", &status, &length) != 2 || getc(resp) != '\n') {
+        fprintf(stderr, "Malformed response from server\n");
+        return EXIT_FAILURE;
+    }
+    FILE *dest = status == 0 ? stdout : stderr;
+    while (length > 0 && (n = fread(buf, 1, length < sizeof(buf) ? length : sizeof(buf), resp)) > 0) {
+        fwrite(buf, 1, n, dest);
+        length -= n;
+    }
+    fclose(resp);
+    fflush(stdout);
+    if (length > 0) {
+        fprintf(stderr, "Truncated response from server\n");
+        return EXIT_FAILURE;
+    }
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
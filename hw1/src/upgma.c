@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "global.h"
+#include "philo.h"
+#include "debug.h"
+
+/* Number of leaves in the cluster rooted at each node. */
+static int cluster_size[MAX_NODES];
+
+/* Height of each node above the leaves (half the distance at which it merged). */
+static double height[MAX_NODES];
+
+/* Position of each active node in active_node_map. */
+static int active_pos[MAX_NODES];
+
+/*
+ * Return the active node nearest to node i.  Ties are resolved in favor
+ * of prefer, which the nearest-neighbor chain needs to guarantee that it
+ * terminates.
+ */
+static int nearest_neighbor(int i, int prefer) {
+    int best = -1;
+    double best_d = 0.0;
+    double *di = distances[i];
+    if (prefer != -1) {
+        best = prefer;
+        best_d = di[prefer];
+        op_counts.cells_touched++;
+    }
+    for (int a = 0; a < num_active_nodes; a++) {
+        int k = active_node_map[a];
+        if (k == i)
+            continue;
+        op_counts.q_evaluations++;
+        op_counts.cells_touched++;
+        if (best == -1 || di[k] < best_d) {
+            best = k;
+            best_d = di[k];
+        }
+    }
+    return best;
+}
+
+/* Remove node i from the active set in O(1). */
+static void deactivate(int i) {
+    int a = active_pos[i];
+    int last = active_node_map[--num_active_nodes];
+    active_node_map[a] = last;
+    op_counts.bytes_moved += sizeof(int);
+    active_pos[last] = a;
+    op_counts.bytes_moved += sizeof(int);
+}
+
+/**
+ * @brief  Build a phylogenetic tree by UPGMA or WPGMA clustering, using the
+ * distance data read by a prior successful invocation of read_distance_data().
+ * @details  This is an alternative to build_taxonomy() that produces the
+ * same kind of tree, output and NODE structures, so emit_newick_format()
+ * and emit_distance_matrix() can be used on the result.  The closest pair of
+ * clusters is found with the nearest-neighbor chain algorithm, which needs
+ * O(N^2) time in total instead of the O(N^3) of repeatedly scanning the
+ * whole matrix.  The chain only grows through mutual nearest neighbors,
+ * which both linkages guarantee to be merged in the same order as the
+ * greedy algorithm would.
+ *
+ * Distances from a merged cluster to the others are the average over all
+ * leaf pairs (UPGMA), or the simple mean of the distances from the two
+ * merged clusters (WPGMA).  Each merge creates an internal node whose
+ * edges to the two merged clusters have lengths equal to the differences
+ * in height.  As in build_taxonomy(), the last two clusters are joined by a
+ * single edge rather than through a root node.
+ *
+ * @param out  If non-NULL, an output stream to which to emit the edge data.
+ * If NULL, then no edge data is output.
+ * @param weighted  Nonzero for WPGMA, zero for UPGMA.
+ * @return 0 in case the output is successfully emitted, otherwise -1
+ * if any error occurred.
+ */
+int build_upgma(FILE *out, int weighted) {
+    int chain[MAX_NODES];
+    int len = 0;
+
+    for (int a = 0; a < num_active_nodes; a++) {
+        int i = active_node_map[a];
+        cluster_size[i] = 1;
+        height[i] = 0.0;
+        active_pos[i] = a;
+        nodes[i].neighbors[0] = nodes[i].neighbors[1] = nodes[i].neighbors[2] = NULL;
+    }
+
+    while (num_active_nodes > 2) {
+        if (len == 0)
+            chain[len++] = active_node_map[0];
+
+        int top = chain[len - 1];
+        int prev = len > 1 ? chain[len - 2] : -1;
+        int nn = nearest_neighbor(top, prev);
+        if (nn != prev) {
+            chain[len++] = nn;
+            continue;
+        }
+
+        // top and prev are mutual nearest neighbors: merge them
+        int i = prev, j = top;
+        int u = num_all_nodes++;
+        double dij = distances[i][j];
+        op_counts.cells_touched++;
+        double ni = cluster_size[i], nj = cluster_size[j];
+        len -= 2;
+
+        height[u] = dij / 2;
+        cluster_size[u] = cluster_size[i] + cluster_size[j];
+        name_internal_node(u);
+        nodes[u].neighbors[0] = NULL;
+        nodes[u].neighbors[1] = &nodes[i];
+        nodes[u].neighbors[2] = &nodes[j];
+        nodes[i].neighbors[0] = &nodes[u];
+        nodes[j].neighbors[0] = &nodes[u];
+
+        double *di = distances[i], *dj = distances[j], *du = distances[u];
+        for (int c = 0; c < num_active_nodes; c++) {
+            int k = active_node_map[c];
+            if (k == i || k == j)
+                continue;
+            double duk = weighted ? (di[k] + dj[k]) / 2
+                                  : (ni * di[k] + nj * dj[k]) / (ni + nj);
+            du[k] = duk;
+            distances[k][u] = duk;
+            op_counts.cells_touched += 4;
+        }
+        du[u] = 0.0;
+        du[i] = distances[i][u] = height[u] - height[i];
+        du[j] = distances[j][u] = height[u] - height[j];
+        op_counts.cells_touched += 5;
+
+        if (out != NULL) {
+            counted_printf(out, "%s,%s,%.2f\n", node_names[i], node_names[u], du[i]);
+            counted_printf(out, "%s,%s,%.2f\n", node_names[j], node_names[u], du[j]);
+        }
+
+        // u takes i's slot in the active set
+        active_node_map[active_pos[i]] = u;
+        op_counts.bytes_moved += sizeof(int);
+        active_pos[u] = active_pos[i];
+        op_counts.bytes_moved += sizeof(int);
+        deactivate(j);
+    }
+
+    if (num_active_nodes == 2) {
+        int i = active_node_map[0];
+        int j = active_node_map[1];
+        // The matrix entry becomes the edge length, as emit_newick_format()
+        // expects; it is unchanged when both are leaves (height 0).
+        double dij = distances[i][j] - height[i] - height[j];
+        distances[i][j] = distances[j][i] = dij;
+        nodes[i].neighbors[0] = &nodes[j];
+        nodes[j].neighbors[0] = &nodes[i];
+        if (out != NULL)
+            counted_printf(out, "%s,%s,%.2f\n", node_names[i], node_names[j], dij);
+    }
+
+    return 0;
+}
@@ -1,6 +1,7 @@
 #include <stdlib.h>
 
 #include "global.h"
+#include "philo.h"
 #include "debug.h"
 
 // Compare string function prototype
@@ -26,9 +27,8 @@ int validargs(int argc, char **argv)
 {
     // Initialize global_options to 0
     global_options = 0;
-
-    // If no arguments or only the program name is provided, return -1
-    if (argc == 1) { return -1;}
+    outlier_name = NULL;
+    socket_path = NULL;
 
     // Check for the -h flag
     for (int i = 1; i < argc; i++) {
@@ -38,7 +38,7 @@ int validargs(int argc, char **argv)
         }
     }
 
-    // Check for the -m and -n options
+    // Check for the remaining options
     for (int i = 1; i < argc; i++) {
         if (compare(argv[i], "-m") == 0) {
             global_options |= MATRIX_OPTION;
@@ -49,21 +49,76 @@ int validargs(int argc, char **argv)
                 outlier_name = argv[i + 2];
                 i += 2; // Skip the next two arguments
             }
+        } else if (compare(argv[i], "-u") == 0) {
+            global_options |= UPGMA_OPTION;
+        } else if (compare(argv[i], "-w") == 0) {
+            global_options |= WPGMA_OPTION;
+        } else if (compare(argv[i], "-t") == 0) {
+            global_options |= TRUST_SYMMETRIC_OPTION;
+        } else if (compare(argv[i], "-r") == 0) {
+            // -r takes the names of the two tree files to compare
+            if (i + 2 >= argc) { return -1; }
+            global_options |= COMPARE_OPTION;
+            compare_files[0] = argv[i + 1];
+            compare_files[1] = argv[i + 2];
+            i += 2;
+        } else if (compare(argv[i], "-s") == 0 || compare(argv[i], "-c") == 0) {
+            if (i + 1 >= argc || socket_path) { return -1; }
+            global_options |= argv[i][1] == 's' ? SERVE_OPTION : CLIENT_OPTION;
+            socket_path = argv[++i];
+        } else {
+            // Unrecognized option, or -o not following -n
+            return -1;
         }
     }
 
+    // A server takes its options from each request
+    if ((global_options & SERVE_OPTION) && global_options != SERVE_OPTION) { return -1; }
+    if ((global_options & CLIENT_OPTION) && (global_options & COMPARE_OPTION)) { return -1; }
+
+    // Comparing trees cannot be combined with building one
+    if ((global_options & COMPARE_OPTION) && global_options != COMPARE_OPTION) { return -1; }
+
+    // Only one clustering method may be selected
+    if ((global_options & UPGMA_OPTION) && (global_options & WPGMA_OPTION)) { return -1; }
+
     // Check for invalid flag combinations
     if ((global_options & MATRIX_OPTION) && (global_options & NEWICK_OPTION)) { return -1; }
 
-    // If neither MATRIX_OPTION nor NEWICK_OPTION is set, return -1
-    if (!(global_options & MATRIX_OPTION) && !(global_options & NEWICK_OPTION)) { return -1; }
-
     // After parsing all flags, check if -o is provided without -n
     if (outlier_name && !(global_options & NEWICK_OPTION)) { return -1; }
 
     return 0;
 }
 
+/**
+ * @brief Prints help for the options not described by the USAGE macro.
+ * @details The text of USAGE in global.h is fixed, so the options added
+ * since are described separately, to the standard error as USAGE is.
+ * This is registered with atexit() before USAGE is invoked, so that it is
+ * printed after the standard help text.
+ */
+void usage_more_options(void)
+{
+    fprintf(stderr,
+"Additional options:\n"
+"   -u         Build the tree by UPGMA clustering instead of neighbor joining.\n"
+"   -w         Build the tree by WPGMA clustering instead of neighbor joining.\n"
+"   -t         Trust that a square distance matrix is symmetric: the entries below\n"
+"              the diagonal are taken from those above it instead of being checked.\n"
+"   -r <file1> <file2>\n"
+"              Compare two trees in Newick format and output their Robinson-Foulds\n"
+"              distance.  The exit status is 0 if the trees are the same, 1 if they\n"
+"              differ and 2 if they could not be compared.\n"
+"   -s <path>  Run a server that builds trees for requests on the Unix socket <path>.\n"
+"   -c <path>  Send the other options and the standard input to the server at <path>\n"
+"              and output its response.\n"
+"\n"
+"The distance data may be in CSV or PHYLIP format, as a square or lower-triangular\n"
+"matrix, and may be compressed with gzip or zstd.\n"
+"\n");
+}
+
 // Custom string comparison and manipulation function
 int compare(const char *str1, const char *str2) {
     while (*str1 && (*str1 == *str2)) {
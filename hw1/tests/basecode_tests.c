@@ -1,8 +1,11 @@
+#include <stdlib.h>
+#include <string.h>
 #include <sys/wait.h>
 #include <criterion/criterion.h>
 #include <criterion/logging.h>
 
 #include "global.h"
+#include "philo.h"
 
 #define progname "bin/philo"
 
@@ -62,6 +65,19 @@ Test(basecode_suite, validargs_newick_test, .timeout = 5) {
 		 outlier_name, outlier);
 }
 
+Test(basecode_suite, validargs_trust_symmetric_test, .timeout = 5) {
+    char *argv[] = {progname, "-t", "-m", NULL};
+    int argc = (sizeof(argv) / sizeof(char *)) - 1;
+    int ret = validargs(argc, argv);
+    int exp_ret = 0;
+    int opt = global_options;
+    int exp_opt = TRUST_SYMMETRIC_OPTION | MATRIX_OPTION;
+    cr_assert_eq(ret, exp_ret, "Invalid return for validargs.  Got: %d | Expected: %d",
+		 ret, exp_ret);
+    cr_assert_eq(opt, exp_opt, "Invalid options settings.  Got: 0x%x | Expected: 0x%x",
+		 opt, exp_opt);
+}
+
 Test(basecode_suite, validargs_error_test, .timeout = 5) {
     char *argv[] = {progname, "-m", "-o", "xyz", NULL};
     int argc = (sizeof(argv) / sizeof(char *)) - 1;
@@ -85,6 +101,25 @@ Test(basecode_suite, help_system_test, .timeout = 5) {
 		 return_code);
 }
 
+Test(basecode_suite, help_options_test, .timeout = 5) {
+    // Every option is described, including those USAGE does not cover
+    char *options[] = {"-m", "-n", "-o", "-u", "-w", "-t", "-r", "-s", "-c"};
+    char help[4096], line[16];
+    system("mkdir -p test_output");
+    int return_code = WEXITSTATUS(system("bin/philo -h 2> test_output/help.out"));
+    cr_assert_eq(return_code, EXIT_SUCCESS, "Program exited with 0x%x instead of EXIT_SUCCESS",
+		 return_code);
+    FILE *f = fopen("test_output/help.out", "r");
+    cr_assert_not_null(f, "Unable to open test_output/help.out");
+    size_t len = fread(help, 1, sizeof(help) - 1, f);
+    help[len] = '\0';
+    fclose(f);
+    for (int i = 0; i < sizeof(options) / sizeof(char *); i++) {
+        snprintf(line, sizeof(line), "\n   %s ", options[i]);
+        cr_assert_not_null(strstr(help, line), "Option %s not described in help", options[i]);
+    }
+}
+
 Test(basecode_suite, philo_basic_test, .timeout = 5) {
     char *cmd = "bin/philo < rsrc/wikipedia.csv > test_output/philo_basic_test.out";
     char *cmp = "cmp test_output/philo_basic_test.out rsrc/wikipedia_edges.out";
@@ -0,0 +1,147 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <criterion/criterion.h>
+#include <criterion/logging.h>
+
+#include "global.h"
+#include "philo.h"
+
+#define progname "bin/philo"
+
+/*
+ * Tests of compare_trees() on small hand-written trees.  The reference
+ * tree has the splits {a,b}, {d,e} and {c,d,e} (equivalently {a,b,f}).
+ */
+#define REFERENCE_TREE "((a:1,b:2)#7:1,(c:1,(d:1,e:1)#8:2)#9:1,f:3);\n"
+
+static char compare_output[4096];
+
+/* Write Newick text to a file under test_output/ and return its path. */
+static char *write_tree(char *name, char *text) {
+    static char paths[2][64];
+    static int next = 0;
+    char *path = paths[next++ % 2];
+    system("mkdir -p test_output");
+    snprintf(path, sizeof(paths[0]), "test_output/%s.nwk", name);
+    FILE *f = fopen(path, "w");
+    cr_assert_not_null(f, "Unable to create %s", path);
+    fputs(text, f);
+    fclose(f);
+    return path;
+}
+
+/*
+ * Compare two trees given as Newick text, leaving the output of
+ * compare_trees() in compare_output, and return its result.
+ */
+static int compare_texts(char *text1, char *text2) {
+    char *file1 = write_tree("compare1", text1);
+    char *file2 = write_tree("compare2", text2);
+    FILE *out = tmpfile();
+    cr_assert_not_null(out, "Unable to create temporary file");
+    int rf = compare_trees(file1, file2, out);
+    rewind(out);
+    size_t len = fread(compare_output, 1, sizeof(compare_output) - 1, out);
+    compare_output[len] = '\0';
+    fclose(out);
+    return rf;
+}
+
+Test(compare_suite, identical_test, .timeout = 5) {
+    int rf = compare_texts(REFERENCE_TREE, REFERENCE_TREE);
+    cr_assert_eq(rf, 0, "Identical trees at RF distance %d", rf);
+}
+
+Test(compare_suite, rerooted_test, .timeout = 5) {
+    // Rooted at the edge to a, with a root of degree two, with different
+    // edge lengths and without internal node names: the same unrooted tree
+    int rf = compare_texts(REFERENCE_TREE, "(a,(b,((c,(d,e)),f)));\n");
+    cr_assert_eq(rf, 0, "Tree rooted at a is at RF distance %d", rf);
+    rf = compare_texts(REFERENCE_TREE, "(((a:1,b:1):5,f:1):2,c:1,(e:4,d:1):1);\n");
+    cr_assert_eq(rf, 0, "Tree rooted at c is at RF distance %d", rf);
+}
+
+Test(compare_suite, one_split_test, .timeout = 5) {
+    // Swapping c and d across an internal edge replaces {d,e} by {c,e}
+    int rf = compare_texts(REFERENCE_TREE, "((a,b),(d,(c,e)),f);\n");
+    cr_assert_eq(rf, 2, "Expected RF distance 2, got %d", rf);
+    cr_assert_not_null(strstr(compare_output, "RF distance: 2 (1 splits only in first tree, "
+                              "1 only in second, 2 shared)\n"),
+                       "Unexpected summary line: %s", compare_output);
+    cr_assert_not_null(strstr(compare_output, "\n< {d,e}\n"),
+                       "Split {d,e} of first tree not reported: %s", compare_output);
+    cr_assert_not_null(strstr(compare_output, "\n> {c,e}\n"),
+                       "Split {c,e} of second tree not reported: %s", compare_output);
+}
+
+Test(compare_suite, disjoint_splits_test, .timeout = 5) {
+    // No nontrivial split in common: each tree has 3 the other lacks
+    int rf = compare_texts(REFERENCE_TREE, "((a,c),(b,(d,f)),e);\n");
+    cr_assert_eq(rf, 6, "Expected RF distance 6, got %d", rf);
+}
+
+Test(compare_suite, leaf_mismatch_test, .timeout = 5) {
+    int rf = compare_texts(REFERENCE_TREE, "((a,b),(c,(d,x)),f);\n");
+    cr_assert_eq(rf, -1, "Trees with different leaves compared (RF %d)", rf);
+    rf = compare_texts(REFERENCE_TREE, "((a,b),(c,d),f);\n");
+    cr_assert_eq(rf, -1, "Trees with different numbers of leaves compared (RF %d)", rf);
+    rf = compare_texts("((a,b),(c,d),e);\n", REFERENCE_TREE);
+    cr_assert_eq(rf, -1, "Trees with different numbers of leaves compared (RF %d)", rf);
+    rf = compare_texts(REFERENCE_TREE, "((a,b),(c,(d,d)),f);\n");
+    cr_assert_eq(rf, -1, "Tree with a duplicate leaf compared (RF %d)", rf);
+}
+
+Test(compare_suite, malformed_test, .timeout = 5) {
+    int rf = compare_texts(REFERENCE_TREE, "((a,b),(c,(d,e)),f\n");
+    cr_assert_eq(rf, -1, "Unterminated tree accepted (RF %d)", rf);
+    rf = compare_texts(REFERENCE_TREE, "((a,b),(c,d,e),f);\n");
+    cr_assert_eq(rf, -1, "Nonbinary tree accepted (RF %d)", rf);
+    rf = compare_trees("test_output/no_such_tree.nwk", write_tree("compare1", REFERENCE_TREE),
+                       stderr);
+    cr_assert_eq(rf, -1, "Missing file accepted (RF %d)", rf);
+}
+
+Test(compare_suite, spaced_names_test, .timeout = 5) {
+    // Names with spaces are written unquoted by -n, and must compare
+    // equal to themselves; only the ends of a label are trimmed
+    system("mkdir -p test_output");
+    FILE *f = fopen("test_output/spaced_names.csv", "w");
+    cr_assert_not_null(f, "Unable to create test input");
+    fprintf(f, ",Homo sapiens,Pan troglodytes,Gorilla gorilla,Pongo abelii\n"
+            "Homo sapiens,0,2,3,5\nPan troglodytes,2,0,3,5\n"
+            "Gorilla gorilla,3,3,0,6\nPongo abelii,5,5,6,0\n");
+    fclose(f);
+    int return_code = WEXITSTATUS(system(progname " -n < test_output/spaced_names.csv"
+                                         " > test_output/spaced_names.nwk"));
+    cr_assert_eq(return_code, EXIT_SUCCESS, "Program exited with %d", return_code);
+    int rf = compare_trees("test_output/spaced_names.nwk", "test_output/spaced_names.nwk",
+                           stderr);
+    cr_assert_eq(rf, 0, "Tree with spaced names at RF distance %d from itself", rf);
+
+    rf = compare_texts("((a b,c),(d,e),f g);\n", "(( a b , c ), (d,e) ,\tf g\t);\n");
+    cr_assert_eq(rf, 0, "Labels not trimmed (RF %d)", rf);
+    rf = compare_texts("((a b,c),(d,e),f g);\n", "((ab,c),(d,e),f g);\n");
+    cr_assert_eq(rf, -1, "Interior space ignored in label (RF %d)", rf);
+}
+
+/*
+ * The exit status of -r tells scripts whether the trees differ without
+ * parsing the output.
+ */
+static int run_compare(char *text1, char *text2) {
+    char cmd[256];
+    char *file1 = write_tree("compare1", text1);
+    char *file2 = write_tree("compare2", text2);
+    snprintf(cmd, sizeof(cmd), "%s -r %s %s > /dev/null 2>&1", progname, file1, file2);
+    return WEXITSTATUS(system(cmd));
+}
+
+Test(compare_suite, exit_status_test, .timeout = 5) {
+    int status = run_compare(REFERENCE_TREE, "(a,(b,((c,(d,e)),f)));\n");
+    cr_assert_eq(status, EXIT_SUCCESS, "Same trees: exit status %d", status);
+    status = run_compare(REFERENCE_TREE, "((a,b),(d,(c,e)),f);\n");
+    cr_assert_eq(status, EXIT_FAILURE, "Different trees: exit status %d", status);
+    status = run_compare(REFERENCE_TREE, "((a,b),(c,(d,x)),f);\n");
+    cr_assert_eq(status, COMPARE_TROUBLE, "Mismatched leaves: exit status %d", status);
+}
@@ -0,0 +1,245 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <criterion/criterion.h>
+#include <criterion/logging.h>
+
+#include "global.h"
+#include "philo.h"
+
+/*
+ * Tests of the input formats accepted by read_distance_data().  Each form
+ * of the same five-taxon matrix must read as the square CSV matrix does.
+ */
+
+#define progname "bin/philo"
+
+#define NUM_FORMAT_TAXA 5
+
+static char *format_names[NUM_FORMAT_TAXA] = {"a", "b", "c", "d", "e"};
+
+static double format_distances[NUM_FORMAT_TAXA][NUM_FORMAT_TAXA] = {
+    {0, 5, 9, 9, 8},
+    {5, 0, 10, 10, 9},
+    {9, 10, 0, 8, 7},
+    {9, 10, 8, 0, 3},
+    {8, 9, 7, 3, 0}
+};
+
+#define SQUARE_CSV \
+    ",a,b,c,d,e\n" \
+    "a,0,5,9,9,8\nb,5,0,10,10,9\nc,9,10,0,8,7\nd,9,10,8,0,3\ne,8,9,7,3,0\n"
+
+/* Read the given text as input, with the given options set, and return the result. */
+static int read_text(char *text, int options) {
+    FILE *f = tmpfile();
+    cr_assert_not_null(f, "Unable to create temporary file");
+    fputs(text, f);
+    rewind(f);
+    global_options = options;
+    memset(&op_counts, 0, sizeof(op_counts));
+    int ret = read_distance_data(f);
+    fclose(f);
+    return ret;
+}
+
+/* Check that input was read, with result ret, as the test matrix. */
+static void check_matrix(int ret, char *what) {
+    cr_assert_eq(ret, 0, "%s input not read", what);
+    cr_assert_eq(num_taxa, NUM_FORMAT_TAXA, "%s input has %d taxa", what, num_taxa);
+    for (int i = 0; i < NUM_FORMAT_TAXA; i++) {
+        double sum = 0;
+        cr_assert_eq(strcmp(node_names[i], format_names[i]), 0,
+                     "%s input: taxon %d is named '%s'", what, i, node_names[i]);
+        for (int j = 0; j < NUM_FORMAT_TAXA; j++) {
+            cr_assert_eq(distances[i][j], format_distances[i][j],
+                         "%s input: distance (%d, %d) is %f", what, i, j, distances[i][j]);
+            sum += format_distances[i][j];
+        }
+        cr_assert_eq(row_sums[i], sum, "%s input: row sum %d is %f", what, i, row_sums[i]);
+    }
+}
+
+/* Check that the given text reads as the test matrix. */
+static void check_format(char *text, int options, char *what) {
+    check_matrix(read_text(text, options), what);
+}
+
+Test(format_suite, csv_test, .timeout = 5) {
+    check_format(SQUARE_CSV, 0, "Square CSV");
+    check_format(",a,b,c,d,e\na\nb,5\nc,9,10\nd,9,10,8\ne,8,9,7,3\n", 0,
+                 "Lower-triangular CSV");
+    check_format(",a,b,c,d,e\na,0\nb,5,0\nc,9,10,0\nd,9,10,8,0\ne,8,9,7,3,0\n", 0,
+                 "Lower-triangular CSV with diagonal");
+}
+
+Test(format_suite, phylip_test, .timeout = 5) {
+    check_format("5\na 0 5 9 9 8\nb 5 0 10 10 9\nc 9 10 0 8 7\nd 9 10 8 0 3\ne 8 9 7 3 0\n",
+                 0, "Square PHYLIP");
+    check_format("  5\na\nb 5\nc 9 10\nd 9 10 8\ne 8 9 7 3\n", 0, "Lower-triangular PHYLIP");
+    check_format("5\na 0\nb 5 0\nc 9 10 0\nd 9 10 8 0\ne 8 9 7 3 0\n", 0,
+                 "Lower-triangular PHYLIP with diagonal");
+    // Tabs and repeated spaces separate fields as single spaces do
+    check_format("5\na\t0  5 9 9 8\nb 5 0 10 10 9\nc 9 10 0 8 7\nd 9 10 8 0 3\ne 8 9 7 3 0\n",
+                 0, "Square PHYLIP with tabs");
+}
+
+Test(format_suite, phylip_interleaved_test, .timeout = 5) {
+    // The layout is given by the number of distances before the second
+    // name, wherever the lines of the first row end
+    check_format("5\na\n0 5 9 9 8\nb 5 0 10 10 9\nc 9 10 0 8 7\nd 9 10 8 0 3\ne 8 9 7 3 0\n",
+                 0, "Square PHYLIP with the first name on its own line");
+    check_format("5\na 0 5\n9 9 8\nb 5 0 10\n10 9\nc 9 10 0 8 7\nd 9 10 8 0 3\ne 8 9 7 3 0\n",
+                 0, "Interleaved square PHYLIP");
+    check_format("5\na 0\nb 5 0\nc 9\n10 0\nd 9 10 8 0\ne 8 9\n7 3 0\n", 0,
+                 "Interleaved lower-triangular PHYLIP with diagonal");
+
+    // A row of the wrong length is reported rather than misread
+    int ret = read_text("5\na 0 5 9\nb 5 0 10 10 9\nc 9 10 0 8 7\nd 9 10 8 0 3\ne 8 9 7 3 0\n", 0);
+    cr_assert_eq(ret, -1, "Short first row accepted");
+    ret = read_text("5\na 0 5 9 9 8\nb 5 0 10 10\nc 9 10 0 8 7\nd 9 10 8 0 3\ne 8 9 7 3 0\n", 0);
+    cr_assert_eq(ret, -1, "Short second row accepted");
+}
+
+Test(format_suite, phylip_relaxed_names_test, .timeout = 5) {
+    int ret = read_text("3\nHomo_sapiens 0 2 3\nPan_troglodytes 2 0 3\n"
+                        "Gorilla_gorilla_gorilla 3 3 0\n", 0);
+    cr_assert_eq(ret, 0, "Names longer than ten characters not accepted");
+    cr_assert_eq(strcmp(node_names[2], "Gorilla_gorilla_gorilla"), 0,
+                 "Long name read as '%s'", node_names[2]);
+}
+
+Test(format_suite, trust_symmetric_test, .timeout = 5) {
+    check_format(SQUARE_CSV, TRUST_SYMMETRIC_OPTION, "Square CSV with -t");
+    long trusted_cells = op_counts.cells_touched;
+    check_format(SQUARE_CSV, 0, "Square CSV");
+    cr_assert(trusted_cells < op_counts.cells_touched,
+              "Trusting symmetry touched %ld cells, checking it %ld",
+              trusted_cells, op_counts.cells_touched);
+    check_format("5\na 0 5 9 9 8\nb 5 0 10 10 9\nc 9 10 0 8 7\nd 9 10 8 0 3\ne 8 9 7 3 0\n",
+                 TRUST_SYMMETRIC_OPTION, "Square PHYLIP with -t");
+
+    // Below the diagonal, entries are skipped unparsed with -t and
+    // checked against those above it otherwise
+    char *asymmetric = ",a,b,c,d,e\n"
+        "a,0,5,9,9,8\nb,x,0,10,10,9\nc,9,10,0,8,7\nd,9,10,8,0,3\ne,8,9,7,4,0\n";
+    check_format(asymmetric, TRUST_SYMMETRIC_OPTION, "Asymmetric CSV with -t");
+    int ret = read_text(asymmetric, 0);
+    cr_assert_eq(ret, -1, "Asymmetric matrix accepted without -t");
+}
+
+Test(format_suite, invalid_distance_test, .timeout = 5) {
+    // strtod() accepts these, but none of them is a distance
+    char *invalid[] = {"inf", "-inf", "INFINITY", "nan", "0x3", "1e999"};
+    char text[256];
+    for (int k = 0; k < sizeof(invalid) / sizeof(char *); k++) {
+        char *d = invalid[k];
+        snprintf(text, sizeof(text), ",a,b,c\na,0,1,%s\nb,1,0,2\nc,%s,2,0\n", d, d);
+        cr_assert_eq(read_text(text, 0), -1, "Distance '%s' accepted in square CSV", d);
+        snprintf(text, sizeof(text), ",a,b,c\na\nb,1\nc,%s,2\n", d);
+        cr_assert_eq(read_text(text, 0), -1, "Distance '%s' accepted in lower-triangular CSV", d);
+        snprintf(text, sizeof(text), "3\na 0 1 %s\nb 1 0 2\nc %s 2 0\n", d, d);
+        cr_assert_eq(read_text(text, 0), -1, "Distance '%s' accepted in square PHYLIP", d);
+        snprintf(text, sizeof(text), "3\na\nb 1\nc %s 2\n", d);
+        cr_assert_eq(read_text(text, 0), -1, "Distance '%s' accepted in lower-triangular PHYLIP", d);
+    }
+}
+
+/*
+ * Compress the square CSV matrix with the given program (gzip or zstd)
+ * into test_output/<name> and return its path.
+ */
+static char *compress_matrix(char *prog, char *name) {
+    static char path[64];
+    char cmd[256];
+    system("mkdir -p test_output");
+    FILE *f = fopen("test_output/format.csv", "w");
+    cr_assert_not_null(f, "Unable to create test input");
+    fputs(SQUARE_CSV, f);
+    fclose(f);
+    snprintf(path, sizeof(path), "test_output/%s", name);
+    snprintf(cmd, sizeof(cmd), "%s -c test_output/format.csv > %s", prog, path);
+    cr_assert_eq(WEXITSTATUS(system(cmd)), EXIT_SUCCESS, "Unable to run %s", prog);
+    return path;
+}
+
+/*
+ * Read the file at the given path as input, either opened directly, so
+ * that the stream is seekable, or through a pipe, and return the result.
+ */
+static int read_file(char *path, int piped) {
+    char cmd[128];
+    FILE *f;
+    snprintf(cmd, sizeof(cmd), "cat %s", path);
+    f = piped ? popen(cmd, "r") : fopen(path, "r");
+    cr_assert_not_null(f, "Unable to open %s", path);
+    global_options = 0;
+    int ret = read_distance_data(f);
+    if (piped)
+        pclose(f);
+    else
+        fclose(f);
+    return ret;
+}
+
+/* Run the program on the file at the given path and return its exit status. */
+static int run_file(char *path, int piped) {
+    char cmd[256];
+    if (piped)
+        snprintf(cmd, sizeof(cmd), "cat %s | %s > /dev/null 2>&1", path, progname);
+    else
+        snprintf(cmd, sizeof(cmd), "%s < %s > /dev/null 2>&1", progname, path);
+    return WEXITSTATUS(system(cmd));
+}
+
+Test(format_suite, compressed_test, .timeout = 10) {
+    char *gz = compress_matrix("gzip", "format.csv.gz");
+    check_matrix(read_file(gz, 0), "Seekable gzip");
+    check_matrix(read_file(gz, 1), "Piped gzip");
+    char *zst = compress_matrix("zstd -q", "format.csv.zst");
+    check_matrix(read_file(zst, 0), "Seekable zstd");
+    check_matrix(read_file(zst, 1), "Piped zstd");
+    int status = run_file(zst, 1);
+    cr_assert_eq(status, EXIT_SUCCESS, "Piped zstd input: exit status %d", status);
+}
+
+/*
+ * Damage the compressed file at the given path, either by cutting it in
+ * half or by inverting a byte in the middle of the compressed data.
+ */
+static void damage_file(char *path, int truncate) {
+    static char data[4096];
+    FILE *f = fopen(path, "r");
+    cr_assert_not_null(f, "Unable to open %s", path);
+    size_t len = fread(data, 1, sizeof(data), f);
+    fclose(f);
+    if (truncate)
+        len /= 2;
+    else
+        data[len / 2] ^= 0xff;
+    f = fopen(path, "w");
+    cr_assert_not_null(f, "Unable to rewrite %s", path);
+    fwrite(data, 1, len, f);
+    fclose(f);
+}
+
+Test(format_suite, compressed_error_test, .timeout = 10) {
+    char *progs[2] = {"gzip", "zstd -q"};
+    char *names[2] = {"damaged.csv.gz", "damaged.csv.zst"};
+    for (int k = 0; k < 2; k++) {
+        for (int truncate = 0; truncate <= 1; truncate++) {
+            char *what = truncate ? "Truncated" : "Corrupt";
+            char *path = compress_matrix(progs[k], names[k]);
+            damage_file(path, truncate);
+            for (int piped = 0; piped <= 1; piped++) {
+                int ret = read_file(path, piped);
+                cr_assert_eq(ret, -1, "%s %s input accepted", what, names[k]);
+                int status = run_file(path, piped);
+                cr_assert_eq(status, EXIT_FAILURE, "%s %s input: exit status %d",
+                             what, names[k], status);
+            }
+        }
+    }
+}
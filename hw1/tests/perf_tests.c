@@ -0,0 +1,245 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <criterion/criterion.h>
+#include <criterion/logging.h>
+
+#include "global.h"
+#include "philo.h"
+
+/*
+ * Operation-count tests.  These put upper bounds on the work done by the
+ * readers, tree builders and emitters, as recorded in op_counts, for
+ * generated inputs of fixed size and seed.  Unlike timings, the counts are
+ * exactly reproducible, so a change that makes the algorithms do
+ * asymptotically more work fails these tests.
+ */
+
+#define GEN_TAXA 64
+#define GEN_SEED 320
+
+/*
+ * Write a random symmetric distance matrix with the given number of taxa
+ * to a temporary file, in square or (if lower is nonzero) lower-triangular
+ * form, and return the file positioned at its start.
+ */
+static FILE *generate_matrix(int n, unsigned long seed, int lower) {
+    static double d[MAX_TAXA][MAX_TAXA];
+    FILE *f = tmpfile();
+    cr_assert_not_null(f, "Unable to create temporary file");
+    for (int i = 0; i < n; i++) {
+        d[i][i] = 0;
+        for (int j = 0; j < i; j++) {
+            seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+            d[i][j] = d[j][i] = 1 + (seed >> 33) % 1000;
+        }
+    }
+    for (int j = 0; j < n; j++)
+        fprintf(f, ",t%d", j);
+    fprintf(f, "\n");
+    for (int i = 0; i < n; i++) {
+        fprintf(f, "t%d", i);
+        for (int j = 0; j < (lower ? i : n); j++)
+            fprintf(f, ",%g", d[i][j]);
+        fprintf(f, "\n");
+    }
+    rewind(f);
+    return f;
+}
+
+static FILE *generate_input(int n, unsigned long seed) {
+    return generate_matrix(n, seed, 0);
+}
+
+static void read_generated(int n) {
+    FILE *f = generate_input(n, GEN_SEED);
+    int ret = read_distance_data(f);
+    fclose(f);
+    cr_assert_eq(ret, 0, "read_distance_data failed on generated input");
+    memset(&op_counts, 0, sizeof(op_counts));
+}
+
+Test(perf_suite, read_counts_test, .timeout = 5) {
+    FILE *f = generate_input(GEN_TAXA, GEN_SEED);
+    memset(&op_counts, 0, sizeof(op_counts));
+    int ret = read_distance_data(f);
+    fclose(f);
+    cr_assert_eq(ret, 0, "read_distance_data failed on generated input");
+    cr_assert_leq(op_counts.cells_touched, 2L * GEN_TAXA * GEN_TAXA,
+                  "Reader touched %ld cells for %d taxa", op_counts.cells_touched, GEN_TAXA);
+    cr_assert_eq(op_counts.allocations, 0, "Reader made %ld allocations",
+                 op_counts.allocations);
+}
+
+Test(perf_suite, read_lower_triangular_test, .timeout = 5) {
+    static double square[MAX_TAXA][MAX_TAXA];
+    static double square_sums[MAX_TAXA];
+    int n = GEN_TAXA;
+    read_generated(n);
+    for (int i = 0; i < n; i++)
+        memcpy(square[i], distances[i], n * sizeof(double));
+    memcpy(square_sums, row_sums, n * sizeof(double));
+
+    FILE *f = generate_matrix(n, GEN_SEED, 1);
+    int ret = read_distance_data(f);
+    fclose(f);
+    cr_assert_eq(ret, 0, "read_distance_data failed on lower-triangular input");
+    // Each distance is parsed once and stored in both halves
+    cr_assert_leq(op_counts.cells_touched, 2L * n * n,
+                  "Reader touched %ld cells for %d taxa", op_counts.cells_touched, n);
+    for (int i = 0; i < n; i++) {
+        cr_assert_eq(row_sums[i], square_sums[i], "Row sum %d differs from square input", i);
+        for (int j = 0; j < n; j++)
+            cr_assert_eq(distances[i][j], square[i][j],
+                         "Distance (%d, %d) differs from square input", i, j);
+    }
+}
+
+Test(perf_suite, nj_counts_test, .timeout = 5) {
+    long n = GEN_TAXA;
+    read_generated(n);
+    int ret = build_taxonomy(NULL);
+    cr_assert_eq(ret, 0, "build_taxonomy failed on generated input");
+
+    // One Q evaluation per active pair per join
+    long q_max = 0;
+    for (long k = 3; k <= n; k++)
+        q_max += k * (k - 1) / 2;
+    cr_assert_leq(op_counts.q_evaluations, q_max,
+                  "Q evaluated %ld times, expected at most %ld", op_counts.q_evaluations, q_max);
+    cr_assert_leq(op_counts.cells_touched, q_max + 6 * n * n,
+                  "Touched %ld matrix cells", op_counts.cells_touched);
+    // Joined nodes are retired by swapping entries of active_node_map
+    cr_assert_leq(op_counts.bytes_moved, 2 * n * (long)sizeof(int),
+                  "Moved %ld bytes retiring joined nodes", op_counts.bytes_moved);
+    cr_assert_eq(op_counts.allocations, 0, "build_taxonomy made %ld allocations",
+                 op_counts.allocations);
+}
+
+Test(perf_suite, small_inputs_test, .timeout = 5) {
+    // Tiny inputs take the same path as large ones; check the tree built
+    // for every size up to 32 taxa, and that no memory is allocated
+    char name[INPUT_MAX];
+    for (int n = 2; n <= 32; n++) {
+        read_generated(n);
+        int ret = build_taxonomy(NULL);
+        cr_assert_eq(ret, 0, "build_taxonomy failed on %d taxa", n);
+        cr_assert_eq(op_counts.allocations, 0, "build_taxonomy made %ld allocations",
+                     op_counts.allocations);
+        cr_assert_eq(num_all_nodes, n == 2 ? 2 : 2 * n - 2,
+                     "%d nodes in tree for %d taxa", num_all_nodes, n);
+        for (int i = 0; i < num_all_nodes; i++) {
+            int degree = 0;
+            for (int k = 0; k < 3; k++)
+                degree += nodes[i].neighbors[k] != NULL;
+            cr_assert_eq(degree, i < n ? 1 : 3, "Node %d of %d-taxon tree has degree %d",
+                         i, n, degree);
+            if (i >= n) {
+                snprintf(name, sizeof(name), "#%d", i);
+                cr_assert_eq(strcmp(nodes[i].name, name), 0, "Node %d is named '%s'",
+                             i, nodes[i].name);
+            }
+        }
+    }
+}
+
+Test(perf_suite, upgma_counts_test, .timeout = 5) {
+    long n = GEN_TAXA;
+    read_generated(n);
+    int ret = build_upgma(NULL, 0);
+    cr_assert_eq(ret, 0, "build_upgma failed on generated input");
+
+    // The nearest-neighbor chain does O(N) scans of O(N) each
+    cr_assert_leq(op_counts.q_evaluations, 4 * n * n,
+                  "Examined %ld pairs, expected O(N^2)", op_counts.q_evaluations);
+    cr_assert_leq(op_counts.cells_touched, 8 * n * n,
+                  "Touched %ld matrix cells", op_counts.cells_touched);
+    cr_assert_leq(op_counts.bytes_moved, 4 * n * (long)sizeof(int),
+                  "Moved %ld bytes retiring joined nodes", op_counts.bytes_moved);
+    cr_assert_eq(op_counts.allocations, 0, "build_upgma made %ld allocations",
+                 op_counts.allocations);
+}
+
+Test(perf_suite, edge_output_counts_test, .timeout = 5) {
+    long n = GEN_TAXA;
+    read_generated(n);
+    FILE *out = fopen("/dev/null", "w");
+    int ret = build_taxonomy(out);
+    fclose(out);
+    cr_assert_eq(ret, 0, "build_taxonomy failed on generated input");
+    cr_assert_eq(op_counts.write_calls, 2 * (n - 2) + 1,
+                 "Made %ld write calls for %ld edges", op_counts.write_calls, 2 * (n - 2) + 1);
+}
+
+Test(perf_suite, newick_output_counts_test, .timeout = 5) {
+    long n = GEN_TAXA;
+    read_generated(n);
+    build_taxonomy(NULL);
+    memset(&op_counts, 0, sizeof(op_counts));
+    FILE *out = fopen("/dev/null", "w");
+    int ret = emit_newick_format(out);
+    fclose(out);
+    cr_assert_eq(ret, 0, "emit_newick_format failed on generated input");
+    cr_assert_leq(op_counts.write_calls, 4 * (2 * n - 2),
+                  "Made %ld write calls for %ld nodes", op_counts.write_calls, 2 * n - 2);
+    cr_assert_leq(op_counts.cells_touched, n * n + 2 * n,
+                  "Touched %ld matrix cells", op_counts.cells_touched);
+}
+
+Test(perf_suite, compare_counts_test, .timeout = 5) {
+    // compare_trees() allocates a fixed number of arrays, whatever the size
+    // of the trees
+    FILE *out = fopen("/dev/null", "w");
+    memset(&op_counts, 0, sizeof(op_counts));
+    int rf = compare_trees("rsrc/stark_familytree_dna_newick.out",
+                           "rsrc/stark_familytree_dna_newick.out", out);
+    fclose(out);
+    cr_assert_eq(rf, 0, "Tree differs from itself (RF distance %d)", rf);
+    cr_assert_leq(1, op_counts.allocations, "Allocations were not counted");
+    cr_assert_leq(op_counts.allocations, 24, "compare_trees made %ld allocations",
+                  op_counts.allocations);
+}
+
+/*
+ * Golden-output tests: run the program on each file in rsrc/ and compare
+ * the output with the reference output stored next to it.
+ */
+static void check_golden(char *name, char *mode, char *opts) {
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "mkdir -p test_output && bin/philo %s < rsrc/%s.csv"
+             " > test_output/%s_%s.out", opts, name, name, mode);
+    int return_code = WEXITSTATUS(system(cmd));
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with 0x%x instead of EXIT_SUCCESS", return_code);
+    snprintf(cmd, sizeof(cmd), "cmp test_output/%s_%s.out rsrc/%s_%s.out",
+             name, mode, name, mode);
+    return_code = WEXITSTATUS(system(cmd));
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Output for %s (%s) did not match reference output.", name, mode);
+}
+
+static void check_golden_all(char *name) {
+    check_golden(name, "edges", "");
+    check_golden(name, "newick", "-n");
+    check_golden(name, "matrix", "-m");
+}
+
+Test(perf_suite, golden_harrison1_test, .timeout = 5) {
+    check_golden_all("harrison1");
+}
+
+Test(perf_suite, golden_harrison2_test, .timeout = 5) {
+    check_golden_all("harrison2");
+}
+
+Test(perf_suite, golden_saitou_nei_test, .timeout = 5) {
+    check_golden_all("saitou_nei");
+}
+
+Test(perf_suite, golden_stark_familytree_dna_test, .timeout = 5) {
+    check_golden_all("stark_familytree_dna");
+}
+
+Test(perf_suite, golden_wikipedia_test, .timeout = 5) {
+    check_golden_all("wikipedia");
+}
@@ -0,0 +1,172 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <criterion/criterion.h>
+#include <criterion/logging.h>
+
+#include "global.h"
+#include "philo.h"
+
+/*
+ * Tests of the server started with -s, driven through the client (-c).
+ * Each test runs its own server on a socket in test_output/ and compares
+ * the responses with the output of the program run directly.
+ */
+
+#define progname "bin/philo"
+#define SOCKET_PATH "test_output/philo.sock"
+
+static pid_t server_pid;
+
+static void start_server(void) {
+    struct timespec pause = {0, 10 * 1000 * 1000};
+    struct stat st;
+    system("mkdir -p test_output");
+    unlink(SOCKET_PATH);
+    server_pid = fork();
+    if (server_pid == 0) {
+        execl(progname, progname, "-s", SOCKET_PATH, (char *)NULL);
+        _exit(EXIT_FAILURE);
+    }
+    cr_assert_leq(0, server_pid, "Unable to start server");
+    for (int k = 0; k < 500 && stat(SOCKET_PATH, &st) != 0; k++)
+        nanosleep(&pause, NULL);
+    nanosleep(&pause, NULL);
+}
+
+static void stop_server(void) {
+    int status;
+    if (server_pid <= 0)
+        return;
+    kill(server_pid, SIGTERM);
+    waitpid(server_pid, &status, 0);
+    server_pid = 0;
+}
+
+/* Run the client with the given options and input, into test_output/<out>. */
+static int run_client(char *opts, char *input, char *out) {
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "%s -c %s %s < %s > test_output/%s",
+             progname, SOCKET_PATH, opts, input, out);
+    return WEXITSTATUS(system(cmd));
+}
+
+static void check_response(char *opts, char *input, char *expected) {
+    char cmd[256];
+    int return_code = run_client(opts, input, "serve_test.out");
+    cr_assert_eq(return_code, EXIT_SUCCESS, "Client exited with %d for %s %s",
+                 return_code, opts, input);
+    snprintf(cmd, sizeof(cmd), "cmp test_output/serve_test.out %s", expected);
+    return_code = WEXITSTATUS(system(cmd));
+    cr_assert_eq(return_code, EXIT_SUCCESS, "Response to %s %s did not match %s",
+                 opts, input, expected);
+}
+
+Test(serve_suite, matrix_isolation_test, .timeout = 20, .init = start_server, .fini = stop_server) {
+    // Larger inputs leave estimated distances to internal nodes in every
+    // worker; none of them may show up in a later, smaller request
+    for (int k = 0; k < 16; k++)
+        check_response("-m", "rsrc/saitou_nei.csv", "rsrc/saitou_nei_matrix.out");
+    for (int k = 0; k < 16; k++)
+        check_response("-m", "rsrc/wikipedia.csv", "rsrc/wikipedia_matrix.out");
+    for (int k = 0; k < 4; k++) {
+        check_response("", "rsrc/harrison1.csv", "rsrc/harrison1_edges.out");
+        check_response("-n", "rsrc/stark_familytree_dna.csv", "rsrc/stark_familytree_dna_newick.out");
+        check_response("-m", "rsrc/harrison2.csv", "rsrc/harrison2_matrix.out");
+    }
+}
+
+Test(serve_suite, options_test, .timeout = 20, .init = start_server, .fini = stop_server) {
+    // An option may contain spaces, as a taxon name may
+    FILE *f = fopen("test_output/spaced_names.csv", "w");
+    cr_assert_not_null(f, "Unable to create test input");
+    fprintf(f, ",Homo sapiens,Pan troglodytes,Gorilla gorilla,Pongo abelii\n"
+            "Homo sapiens,0,2,3,5\nPan troglodytes,2,0,3,5\n"
+            "Gorilla gorilla,3,3,0,6\nPongo abelii,5,5,6,0\n");
+    fclose(f);
+    int return_code = WEXITSTATUS(system(progname " -n -o 'Pongo abelii'"
+                                         " < test_output/spaced_names.csv > test_output/spaced_names.out"));
+    cr_assert_eq(return_code, EXIT_SUCCESS, "Program exited with %d", return_code);
+    check_response("-n -o 'Pongo abelii'", "test_output/spaced_names.csv",
+                   "test_output/spaced_names.out");
+
+    // Errors are reported with a failure status
+    return_code = run_client("-n -o 'Homo'", "test_output/spaced_names.csv", "serve_test.out");
+    cr_assert_eq(return_code, EXIT_FAILURE, "Unknown outlier accepted (status %d)", return_code);
+    return_code = run_client("-n -n -n -n -n -n -n -n -n -n -n -n -n -n -n -n -n",
+                             "rsrc/wikipedia.csv", "serve_test.out");
+    cr_assert_eq(return_code, EXIT_FAILURE, "Too many options accepted (status %d)", return_code);
+
+    // The server still answers after the failed requests
+    check_response("-n", "rsrc/wikipedia.csv", "rsrc/wikipedia_newick.out");
+}
+
+/*
+ * Connect to the server and send the start of a request, without the
+ * distance data or the end of the input.  Returns the connected socket.
+ */
+static int start_stalled_request(void) {
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    cr_assert_leq(0, fd, "Unable to create socket");
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, SOCKET_PATH);
+    cr_assert_eq(connect(fd, (struct sockaddr *)&addr, sizeof(addr)), 0,
+                 "Unable to connect to server");
+    cr_assert_eq(write(fd, "1\n-n\n", 5), 5, "Unable to send request");
+    return fd;
+}
+
+Test(serve_suite, stalled_client_test, .timeout = 20, .init = start_server, .fini = stop_server) {
+    // Stall as many requests as there are workers; each must be failed
+    // after the timeout so that a complete request is still answered
+    long num_stalled = sysconf(_SC_NPROCESSORS_ONLN);
+    int stalled[64];
+    struct timespec start, end;
+    if (num_stalled < 1)
+        num_stalled = 1;
+    if (num_stalled > 64)
+        num_stalled = 64;
+    for (int k = 0; k < num_stalled; k++)
+        stalled[k] = start_stalled_request();
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    check_response("-n", "rsrc/wikipedia.csv", "rsrc/wikipedia_newick.out");
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    cr_assert_leq(elapsed, 5.0, "Request behind stalled clients took %.1f seconds", elapsed);
+
+    for (int k = 0; k < num_stalled; k++) {
+        char response[256];
+        ssize_t len = read(stalled[k], response, sizeof(response) - 1);
+        cr_assert_leq(2, len, "No response to stalled request");
+        response[len] = '\0';
+        cr_assert_eq(strncmp(response, "1 ", 2), 0, "Stalled request did not fail: %s", response);
+        cr_assert_not_null(strstr(response, "not received"), "Unexpected response: %s", response);
+        close(stalled[k]);
+    }
+}
+
+Test(serve_suite, existing_file_test, .timeout = 5) {
+    // A path that is not a socket is left alone rather than replaced
+    system("mkdir -p test_output");
+    FILE *f = fopen("test_output/not_a_socket.txt", "w");
+    cr_assert_not_null(f, "Unable to create test file");
+    fputs("keep\n", f);
+    fclose(f);
+    int return_code = WEXITSTATUS(system(progname " -s test_output/not_a_socket.txt"
+                                         " 2> /dev/null"));
+    cr_assert_eq(return_code, EXIT_FAILURE, "Server started on a regular file (status %d)",
+                 return_code);
+    return_code = WEXITSTATUS(system("grep -qx keep test_output/not_a_socket.txt"));
+    cr_assert_eq(return_code, EXIT_SUCCESS, "Regular file was removed or changed");
+}
@@ -0,0 +1,57 @@
+#include <stdlib.h>
+#include <string.h>
+#include <criterion/criterion.h>
+#include <criterion/logging.h>
+
+#include "global.h"
+#include "philo.h"
+
+/*
+ * Tests of build_upgma() on the five-taxon example of the Wikipedia
+ * articles on UPGMA and WPGMA.  The two methods join the same clusters at
+ * the same heights up to the last join, where the root is at height 16.5
+ * for UPGMA and 17.5 for WPGMA.  Since the tree is output unrooted, the
+ * two edges to the root are reported as one, of length 5.5 + 2.5 = 8 or
+ * 6.5 + 3.5 = 10.
+ */
+#define UPGMA_INPUT \
+    ",a,b,c,d,e\n" \
+    "a,0,17,21,31,23\nb,17,0,30,34,21\nc,21,30,0,28,39\nd,31,34,28,0,43\ne,23,21,39,43,0\n"
+
+#define UPGMA_EDGES \
+    "a,#5,8.50\nb,#5,8.50\n#5,#6,2.50\ne,#6,11.00\nc,#7,14.00\nd,#7,14.00\n"
+
+/*
+ * Build the tree for the example by UPGMA or (if weighted is nonzero)
+ * WPGMA and check that the edges output are the expected ones.
+ */
+static void check_upgma(int weighted, char *expected) {
+    char output[1024];
+    FILE *in = tmpfile();
+    FILE *out = tmpfile();
+    cr_assert_not_null(in, "Unable to create temporary file");
+    cr_assert_not_null(out, "Unable to create temporary file");
+    fputs(UPGMA_INPUT, in);
+    rewind(in);
+    global_options = 0;
+    int ret = read_distance_data(in);
+    fclose(in);
+    cr_assert_eq(ret, 0, "read_distance_data failed");
+
+    ret = build_upgma(out, weighted);
+    cr_assert_eq(ret, 0, "build_upgma failed");
+    rewind(out);
+    size_t len = fread(output, 1, sizeof(output) - 1, out);
+    output[len] = '\0';
+    fclose(out);
+    cr_assert_eq(strcmp(output, expected), 0, "%s edges were:\n%s",
+                 weighted ? "WPGMA" : "UPGMA", output);
+}
+
+Test(upgma_suite, upgma_test, .timeout = 5) {
+    check_upgma(0, UPGMA_EDGES "#6,#7,8.00\n");
+}
+
+Test(upgma_suite, wpgma_test, .timeout = 5) {
+    check_upgma(1, UPGMA_EDGES "#6,#7,10.00\n");
+}